@@ -43,6 +43,9 @@ Project located at <https://github.com/benblazak/ergodox-firmware>
 
 #define TAPPING_TERM    230
 
+/* Pack macro strokes into NKRO reports */
+//#define MACRO_PACKING_ENABLE
+
 /* Mechanical locking support. Use KC_LCAP, KC_LNUM or KC_LSCR instead in keymap */
 #define LOCKING_SUPPORT_ENABLE
 /* Locking resynchronize hack */
@@ -27,46 +27,50 @@ Most used files are located at
 
 #include <stdint.h>
 #include <stdbool.h>
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include <util/delay.h>
 #include "action.h"
 #include "command.h"
 #include "print.h"
+#include "timer.h"
+#include "host.h"
+#include "led.h"
 #include "debug.h"
+#include "hook.h"
 #include "ergodox.h"
-#include "i2cmaster.h"
 
 bool i2c_initialized = 0;
 uint8_t mcp23018_status = 0x20;
 
 void init_ergodox(void)
 {
-    // keyboard LEDs (see "PWM on ports OC1(A|B|C)" in "teensy-2-0.md")
-    TCCR1A = 0b10101001;  // set and configure fast PWM
-    TCCR1B = 0b00001001;  // set and configure fast PWM
-
-    // (tied to Vcc for hardware convenience)
-    DDRB  &= ~(1<<4);  // set B(4) as input
-    PORTB &= ~(1<<4);  // set B(4) internal pull-up disabled
-
-    // unused pins - C7, D4, D5, D7, E6
-    // set as input with internal pull-ip enabled
-    DDRC  &= ~(1<<7);
-    DDRD  &= ~(1<<7 | 1<<5 | 1<<4);
-    DDRE  &= ~(1<<6);
-    PORTC |=  (1<<7);
-    PORTD |=  (1<<7 | 1<<5 | 1<<4);
-    PORTE |=  (1<<6);
+    ergodox_hal_init();
 }
 
+// blink is ended by ergodox_blink_task() instead of waiting
+static uint16_t blink_time = 0;
+
 void ergodox_blink_all_leds(void)
 {
     ergodox_led_all_off();
     ergodox_led_all_set(LED_BRIGHTNESS_HI);
     ergodox_led_all_on();
-    _delay_ms(333);
-    ergodox_led_all_off();
+    blink_time = timer_read() | 1;
+}
+
+void ergodox_blink_task(void)
+{
+    if (blink_time && timer_elapsed(blink_time) >= 333) {
+        blink_time = 0;
+        ergodox_led_all_off();
+        led_set(host_keyboard_leds());
+    }
+}
+
+// left side may not be up yet when bootmagic scans
+bool hook_bootmagic_matrix_ready(void) {
+    if (mcp23018_status) {
+        mcp23018_status = init_mcp23018();
+    }
+    return !mcp23018_status;
 }
 
 uint8_t init_mcp23018(void) {
@@ -74,32 +78,25 @@ uint8_t init_mcp23018(void) {
 
     // I2C subsystem
     if (i2c_initialized == 0) {
-        i2c_init();  // on pins D(1,0)
+        ergodox_i2c_init();
         i2c_initialized++;
-        _delay_ms(100);
+        // no wait for MCP23018, it is retried in bootmagic and matrix_scan() if not ready
     }
 
     // set pin direction
     // - unused  : input  : 1
     // - input   : input  : 1
     // - driving : output : 0
-    mcp23018_status = i2c_start(I2C_ADDR_WRITE);    if (mcp23018_status) goto out;
-    mcp23018_status = i2c_write(IODIRA);            if (mcp23018_status) goto out;
-    mcp23018_status = i2c_write(0b00000000);        if (mcp23018_status) goto out;
-    mcp23018_status = i2c_write(0b00111111);        if (mcp23018_status) goto out;
-    i2c_stop();
+    static const uint8_t iodir[] = { IODIRA, 0b00000000, 0b00111111 };
+    mcp23018_status = ergodox_i2c_write(I2C_ADDR, iodir, sizeof(iodir));
+    if (mcp23018_status) return mcp23018_status;
 
     // set pull-up
     // - unused  : on  : 1
     // - input   : on  : 1
     // - driving : off : 0
-    mcp23018_status = i2c_start(I2C_ADDR_WRITE);    if (mcp23018_status) goto out;
-    mcp23018_status = i2c_write(GPPUA);             if (mcp23018_status) goto out;
-    mcp23018_status = i2c_write(0b00000000);        if (mcp23018_status) goto out;
-    mcp23018_status = i2c_write(0b00111111);        if (mcp23018_status) goto out;
-
-out:
-    i2c_stop();
+    static const uint8_t gppu[] = { GPPUA, 0b00000000, 0b00111111 };
+    mcp23018_status = ergodox_i2c_write(I2C_ADDR, gppu, sizeof(gppu));
 
     return mcp23018_status;
 }
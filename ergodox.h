@@ -26,16 +26,15 @@ Most used files are located at
 
 #include <stdint.h>
 #include <stdbool.h>
-#include <avr/io.h>
-#include "i2cmaster.h"
+#include "ergodox_hal.h"
 
+#if defined(__AVR__)
 #define CPU_PRESCALE(n) (CLKPR = 0x80, CLKPR = (n))
 #define CPU_16MHz       0x00
+#endif
 
 // I2C aliases and register addresses (see "mcp23018.md")
 #define I2C_ADDR        0b0100000
-#define I2C_ADDR_WRITE  ( (I2C_ADDR<<1) | I2C_WRITE )
-#define I2C_ADDR_READ   ( (I2C_ADDR<<1) | I2C_READ  )
 #define IODIRA          0x00            // i/o direction register
 #define IODIRB          0x01
 #define GPPUA           0x0C            // GPIO pull-up resistor register
@@ -49,22 +48,23 @@ extern uint8_t mcp23018_status;
 
 void init_ergodox(void);
 void ergodox_blink_all_leds(void);
+void ergodox_blink_task(void);
 uint8_t init_mcp23018(void);
 
 #define LED_BRIGHTNESS_LO       31
 #define LED_BRIGHTNESS_HI       100
 
-inline void __attribute__((always_inline)) ergodox_board_led_on(void)      { DDRD |=  (1<<6); PORTD |=  (1<<6); }
-inline void __attribute__((always_inline)) ergodox_right_led_1_on(void)    { DDRB |=  (1<<5); PORTB |=  (1<<5); }
-inline void __attribute__((always_inline)) ergodox_right_led_2_on(void)    { DDRB |=  (1<<6); PORTB |=  (1<<6); }
-inline void __attribute__((always_inline)) ergodox_right_led_3_on(void)    { DDRB |=  (1<<7); PORTB |=  (1<<7); }
+static inline void __attribute__((always_inline)) ergodox_board_led_on(void)      { gpio_set_output_high(LED_BOARD_PIN); }
+static inline void __attribute__((always_inline)) ergodox_right_led_1_on(void)    { gpio_set_output_high(LED_1_PIN); }
+static inline void __attribute__((always_inline)) ergodox_right_led_2_on(void)    { gpio_set_output_high(LED_2_PIN); }
+static inline void __attribute__((always_inline)) ergodox_right_led_3_on(void)    { gpio_set_output_high(LED_3_PIN); }
 
-inline void __attribute__((always_inline)) ergodox_board_led_off(void)     { DDRD &= ~(1<<6); PORTD &= ~(1<<6); }
-inline void __attribute__((always_inline)) ergodox_right_led_1_off(void)   { DDRB &= ~(1<<5); PORTB &= ~(1<<5); }
-inline void __attribute__((always_inline)) ergodox_right_led_2_off(void)   { DDRB &= ~(1<<6); PORTB &= ~(1<<6); }
-inline void __attribute__((always_inline)) ergodox_right_led_3_off(void)   { DDRB &= ~(1<<7); PORTB &= ~(1<<7); }
+static inline void __attribute__((always_inline)) ergodox_board_led_off(void)     { gpio_set_input(LED_BOARD_PIN); }
+static inline void __attribute__((always_inline)) ergodox_right_led_1_off(void)   { gpio_set_input(LED_1_PIN); }
+static inline void __attribute__((always_inline)) ergodox_right_led_2_off(void)   { gpio_set_input(LED_2_PIN); }
+static inline void __attribute__((always_inline)) ergodox_right_led_3_off(void)   { gpio_set_input(LED_3_PIN); }
 
-inline void __attribute__((always_inline))ergodox_led_all_on(void)
+static inline void __attribute__((always_inline)) ergodox_led_all_on(void)
 {
     ergodox_board_led_on();
     ergodox_right_led_1_on();
@@ -72,7 +72,7 @@ inline void __attribute__((always_inline))ergodox_led_all_on(void)
     ergodox_right_led_3_on();
 }
 
-inline void __attribute__((always_inline))ergodox_led_all_off(void)
+static inline void __attribute__((always_inline)) ergodox_led_all_off(void)
 {
     ergodox_board_led_off();
     ergodox_right_led_1_off();
@@ -80,11 +80,11 @@ inline void __attribute__((always_inline))ergodox_led_all_off(void)
     ergodox_right_led_3_off();
 }
 
-inline void __attribute__((always_inline))ergodox_right_led_1_set(uint8_t n)    { OCR1A = n; }
-inline void __attribute__((always_inline))ergodox_right_led_2_set(uint8_t n)    { OCR1B = n; }
-inline void __attribute__((always_inline))ergodox_right_led_3_set(uint8_t n)    { OCR1C = n; }
+static inline void __attribute__((always_inline)) ergodox_right_led_1_set(uint8_t n)    { ergodox_hal_led_brightness(1, n); }
+static inline void __attribute__((always_inline)) ergodox_right_led_2_set(uint8_t n)    { ergodox_hal_led_brightness(2, n); }
+static inline void __attribute__((always_inline)) ergodox_right_led_3_set(uint8_t n)    { ergodox_hal_led_brightness(3, n); }
 
-inline void __attribute__((always_inline))ergodox_led_all_set(uint8_t n)
+static inline void __attribute__((always_inline)) ergodox_led_all_set(uint8_t n)
 {
     ergodox_right_led_1_set(n);
     ergodox_right_led_2_set(n);
@@ -0,0 +1,109 @@
+/*
+Copyright 2026 Alexander Neumann <alexander@bumpern.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * GPIO and I2C used by ErgoDox matrix, MCP23018 and LEDs
+ *
+ * Pins are given as constants, so that GPIO functions are inlined into
+ * single instructions on AVR. Backend is AVR(Teensy 2.0) by default, or
+ * ChibiOS with PROTOCOL_CHIBIOS where board config.h gives pins as PAL lines.
+ */
+#ifndef ERGODOX_HAL_H
+#define ERGODOX_HAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#if defined(PROTOCOL_CHIBIOS)
+#include "ch.h"
+#include "hal.h"
+
+typedef ioline_t pin_t;
+
+static inline void gpio_set_input(pin_t pin)        { palSetLineMode(pin, PAL_MODE_INPUT); }
+static inline void gpio_set_input_pullup(pin_t pin) { palSetLineMode(pin, PAL_MODE_INPUT_PULLUP); }
+static inline void gpio_set_output_low(pin_t pin)   { palClearLine(pin); palSetLineMode(pin, PAL_MODE_OUTPUT_PUSHPULL); }
+static inline void gpio_set_output_high(pin_t pin)  { palSetLine(pin); palSetLineMode(pin, PAL_MODE_OUTPUT_PUSHPULL); }
+static inline bool gpio_read(pin_t pin)             { return palReadLine(pin); }
+
+/* I2C driver and transfer timeout(ms) */
+#ifndef ERGODOX_I2C_DRIVER
+#define ERGODOX_I2C_DRIVER  I2CD1
+#endif
+#ifndef ERGODOX_I2C_TIMEOUT
+#define ERGODOX_I2C_TIMEOUT 10
+#endif
+
+/* pins are board specific */
+#if !defined(ROW7_PIN) || !defined(COL0_PIN) || !defined(LED_BOARD_PIN)
+#error "ROWn_PIN, COLn_PIN and LED_*_PIN must be defined as PAL lines in config.h"
+#endif
+
+
+#else /* AVR */
+#include <avr/io.h>
+
+/* I/O address of PINx and bit, DDRx and PORTx follow PINx */
+typedef uint8_t pin_t;
+#define PIN_DEF(port, bit)  ((uint8_t)((_SFR_IO_ADDR(PIN##port) << 3) | (bit)))
+#define PIN_REG(pin)        _SFR_IO8((pin) >> 3)
+#define DDR_REG(pin)        _SFR_IO8(((pin) >> 3) + 1)
+#define PORT_REG(pin)       _SFR_IO8(((pin) >> 3) + 2)
+#define PIN_MASK(pin)       (1 << ((pin) & 7))
+
+static inline void gpio_set_input(pin_t pin)        { DDR_REG(pin) &= ~PIN_MASK(pin); PORT_REG(pin) &= ~PIN_MASK(pin); }
+static inline void gpio_set_input_pullup(pin_t pin) { DDR_REG(pin) &= ~PIN_MASK(pin); PORT_REG(pin) |=  PIN_MASK(pin); }
+static inline void gpio_set_output_low(pin_t pin)   { DDR_REG(pin) |=  PIN_MASK(pin); PORT_REG(pin) &= ~PIN_MASK(pin); }
+static inline void gpio_set_output_high(pin_t pin)  { DDR_REG(pin) |=  PIN_MASK(pin); PORT_REG(pin) |=  PIN_MASK(pin); }
+static inline bool gpio_read(pin_t pin)             { return PIN_REG(pin) & PIN_MASK(pin); }
+
+/* Teensy 2.0, see "Row pin configuration" and "Column pin configuration" in matrix.c */
+#define ROW7_PIN        PIN_DEF(B, 0)
+#define ROW8_PIN        PIN_DEF(B, 1)
+#define ROW9_PIN        PIN_DEF(B, 2)
+#define ROW10_PIN       PIN_DEF(B, 3)
+#define ROW11_PIN       PIN_DEF(D, 2)
+#define ROW12_PIN       PIN_DEF(D, 3)
+#define ROW13_PIN       PIN_DEF(C, 6)
+#define COL0_PIN        PIN_DEF(F, 0)
+#define COL1_PIN        PIN_DEF(F, 1)
+#define COL2_PIN        PIN_DEF(F, 4)
+#define COL3_PIN        PIN_DEF(F, 5)
+#define COL4_PIN        PIN_DEF(F, 6)
+#define COL5_PIN        PIN_DEF(F, 7)
+#define LED_BOARD_PIN   PIN_DEF(D, 6)
+#define LED_1_PIN       PIN_DEF(B, 5)   /* OC1A */
+#define LED_2_PIN       PIN_DEF(B, 6)   /* OC1B */
+#define LED_3_PIN       PIN_DEF(B, 7)   /* OC1C */
+#endif
+
+
+/* pins, PWM and I2C bus */
+void ergodox_hal_init(void);
+
+/* brightness of right LEDs(1-3) while on, 0-255 */
+void ergodox_hal_led_brightness(uint8_t led, uint8_t n);
+
+/* I2C transactions with 7-bit address, return 0 on success
+ * write_read sends data then reads with repeated start */
+void ergodox_i2c_init(void);
+uint8_t ergodox_i2c_write(uint8_t addr, const uint8_t *data, uint8_t len);
+uint8_t ergodox_i2c_write_read(uint8_t addr, const uint8_t *data, uint8_t len,
+                               uint8_t *buf, uint8_t size);
+
+#endif
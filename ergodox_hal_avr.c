@@ -0,0 +1,92 @@
+/*
+Copyright 2013 Oleg Kostyuk <cub.uanic@gmail.com>
+Copyright 2026 Alexander Neumann <alexander@bumpern.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * ErgoDox HAL for Teensy 2.0: Timer1 PWM for LEDs and TWI with twimaster.c
+ */
+#if defined(__AVR__)
+#include <stdint.h>
+#include <avr/io.h>
+#include "ergodox_hal.h"
+#include "i2cmaster.h"
+
+
+void ergodox_hal_init(void)
+{
+    // keyboard LEDs (see "PWM on ports OC1(A|B|C)" in "teensy-2-0.md")
+    TCCR1A = 0b10101001;  // set and configure fast PWM
+    TCCR1B = 0b00001001;  // set and configure fast PWM
+
+    // (tied to Vcc for hardware convenience)
+    DDRB  &= ~(1<<4);  // set B(4) as input
+    PORTB &= ~(1<<4);  // set B(4) internal pull-up disabled
+
+    // unused pins - C7, D4, D5, D7, E6
+    // set as input with internal pull-ip enabled
+    DDRC  &= ~(1<<7);
+    DDRD  &= ~(1<<7 | 1<<5 | 1<<4);
+    DDRE  &= ~(1<<6);
+    PORTC |=  (1<<7);
+    PORTD |=  (1<<7 | 1<<5 | 1<<4);
+    PORTE |=  (1<<6);
+}
+
+void ergodox_hal_led_brightness(uint8_t led, uint8_t n)
+{
+    switch (led) {
+        case 1: OCR1A = n; break;
+        case 2: OCR1B = n; break;
+        case 3: OCR1C = n; break;
+    }
+}
+
+
+void ergodox_i2c_init(void)
+{
+    i2c_init();  // on pins D(1,0)
+}
+
+uint8_t ergodox_i2c_write(uint8_t addr, const uint8_t *data, uint8_t len)
+{
+    uint8_t status = i2c_start((addr<<1) | I2C_WRITE);
+    while (!status && len--) {
+        status = i2c_write(*data++);
+    }
+    i2c_stop();
+    return status;
+}
+
+uint8_t ergodox_i2c_write_read(uint8_t addr, const uint8_t *data, uint8_t len,
+                               uint8_t *buf, uint8_t size)
+{
+    uint8_t status = i2c_start((addr<<1) | I2C_WRITE);
+    while (!status && len--) {
+        status = i2c_write(*data++);
+    }
+    if (!status) {
+        status = i2c_rep_start((addr<<1) | I2C_READ);
+    }
+    if (!status) {
+        while (size--) {
+            *buf++ = size ? i2c_readAck() : i2c_readNak();
+        }
+    }
+    i2c_stop();
+    return status;
+}
+#endif
@@ -0,0 +1,114 @@
+/*
+Copyright 2026 Alexander Neumann <alexander@bumpern.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * ErgoDox HAL for ChibiOS
+ *
+ * I2C transfers go through ChibiOS I2C driver, which uses DMA on STM32 with
+ * STM32_I2C_USE_DMA(default). The calling scan thread sleeps during the
+ * transfer instead of polling TWI like on AVR. Board config.h gives pins as
+ * PAL lines and ERGODOX_I2C_CONFIG for i2cStart(), and optionally
+ * ERGODOX_LED_PWM with ERGODOX_LED_PWM_CONFIG and ERGODOX_LED_n_CHANNEL for
+ * brightness of right LEDs.
+ */
+#ifdef PROTOCOL_CHIBIOS
+#include <string.h>
+#include "ch.h"
+#include "hal.h"
+#include "ergodox_hal.h"
+
+#ifndef ERGODOX_I2C_CONFIG
+#error "ERGODOX_I2C_CONFIG must be defined as I2CConfig for the board"
+#endif
+
+static const I2CConfig i2c_config = ERGODOX_I2C_CONFIG;
+
+#ifdef ERGODOX_LED_PWM
+static const PWMConfig pwm_config = ERGODOX_LED_PWM_CONFIG;
+#endif
+
+/* DMA can't access all memory on some MCUs, transfer through static buffers */
+#define I2C_BUFFER_SIZE 8
+static uint8_t i2c_tx[I2C_BUFFER_SIZE];
+static uint8_t i2c_rx[I2C_BUFFER_SIZE];
+
+
+void ergodox_hal_init(void)
+{
+#ifdef ERGODOX_LED_PWM
+    pwmStart(&ERGODOX_LED_PWM, &pwm_config);
+#endif
+}
+
+void ergodox_hal_led_brightness(uint8_t led, uint8_t n)
+{
+#ifdef ERGODOX_LED_PWM
+    static const pwmchannel_t channel[] = {
+        ERGODOX_LED_1_CHANNEL, ERGODOX_LED_2_CHANNEL, ERGODOX_LED_3_CHANNEL
+    };
+    if (led < 1 || led > 3) return;
+    pwmEnableChannel(&ERGODOX_LED_PWM, channel[led - 1],
+                     PWM_FRACTION_TO_WIDTH(&ERGODOX_LED_PWM, 255, n));
+#else
+    (void)led;
+    (void)n;
+#endif
+}
+
+
+void ergodox_i2c_init(void)
+{
+    i2cStart(&ERGODOX_I2C_DRIVER, &i2c_config);
+}
+
+uint8_t ergodox_i2c_write_read(uint8_t addr, const uint8_t *data, uint8_t len,
+                               uint8_t *buf, uint8_t size)
+{
+    if (len > I2C_BUFFER_SIZE || size > I2C_BUFFER_SIZE) return 1;
+
+#if I2C_USE_MUTUAL_EXCLUSION
+    i2cAcquireBus(&ERGODOX_I2C_DRIVER);
+#endif
+    memcpy(i2c_tx, data, len);
+    uint8_t rx_size = size;
+#if defined(STM32F1XX_I2C)
+    /* I2Cv1 on STM32F1 can't receive one byte, MCP23018 goes on to next
+     * register and extra byte is ignored */
+    if (rx_size == 1) rx_size = 2;
+#endif
+    msg_t status = i2cMasterTransmitTimeout(&ERGODOX_I2C_DRIVER, addr,
+                                            i2c_tx, len, i2c_rx, rx_size,
+                                            MS2ST(ERGODOX_I2C_TIMEOUT));
+    if (status == MSG_OK) {
+        if (size) memcpy(buf, i2c_rx, size);
+    } else if (status == MSG_TIMEOUT) {
+        /* driver is unusable after timeout until restarted */
+        i2cStop(&ERGODOX_I2C_DRIVER);
+        i2cStart(&ERGODOX_I2C_DRIVER, &i2c_config);
+    }
+#if I2C_USE_MUTUAL_EXCLUSION
+    i2cReleaseBus(&ERGODOX_I2C_DRIVER);
+#endif
+
+    return status != MSG_OK;
+}
+
+uint8_t ergodox_i2c_write(uint8_t addr, const uint8_t *data, uint8_t len)
+{
+    return ergodox_i2c_write_read(addr, data, len, NULL, 0);
+}
+#endif
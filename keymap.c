@@ -16,8 +16,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <stdint.h>
 #include <stdbool.h>
-#include <avr/pgmspace.h>
-#include <util/delay.h>
+#include "progmem.h"
 #include "keycode.h"
 #include "action.h"
 #include "action_util.h"
@@ -28,8 +27,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "report.h"
 #include "host.h"
 #include "print.h"
+#include "wait.h"
 #include "debug.h"
 #include "keymap.h"
+#include "action_combo.h"
 #include "ergodox.h"
 
 
@@ -75,6 +76,50 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
     { KC_##k0D,KC_##k1D,KC_##k2D,KC_##k3D,KC_##k4D,KC_NO   }    \
    }
 
+#ifdef COMBO_ENABLE
+/* ErgoDox combo index definition macro, each key takes set of COMBO_BIT(id) */
+#define COMBOMAP(                                               \
+                                                                \
+    /* left hand, spatial positions */                          \
+    k00,k01,k02,k03,k04,k05,k06,                                \
+    k10,k11,k12,k13,k14,k15,k16,                                \
+    k20,k21,k22,k23,k24,k25,                                    \
+    k30,k31,k32,k33,k34,k35,k36,                                \
+    k40,k41,k42,k43,k44,                                        \
+                            k55,k56,                            \
+                                k54,                            \
+                        k53,k52,k51,                            \
+                                                                \
+    /* right hand, spatial positions */                         \
+        k07,k08,k09,k0A,k0B,k0C,k0D,                            \
+        k17,k18,k19,k1A,k1B,k1C,k1D,                            \
+            k28,k29,k2A,k2B,k2C,k2D,                            \
+        k37,k38,k39,k3A,k3B,k3C,k3D,                            \
+                k49,k4A,k4B,k4C,k4D,                            \
+    k57,k58,                                                    \
+    k59,                                                        \
+    k5C,k5B,k5A )                                               \
+                                                                \
+   /* matrix positions */                                       \
+   {                                                            \
+    { k00,k10,k20,k30,k40,0   },                                \
+    { k01,k11,k21,k31,k41,k51 },                                \
+    { k02,k12,k22,k32,k42,k52 },                                \
+    { k03,k13,k23,k33,k43,k53 },                                \
+    { k04,k14,k24,k34,k44,k54 },                                \
+    { k05,k15,k25,k35,0,  k55 },                                \
+    { k06,k16,0,  k36,0,  k56 },                                \
+                                                                \
+    { k07,k17,0,  k37,0,  k57 },                                \
+    { k08,k18,k28,k38,0,  k58 },                                \
+    { k09,k19,k29,k39,k49,k59 },                                \
+    { k0A,k1A,k2A,k3A,k4A,k5A },                                \
+    { k0B,k1B,k2B,k3B,k4B,k5B },                                \
+    { k0C,k1C,k2C,k3C,k4C,k5C },                                \
+    { k0D,k1D,k2D,k3D,k4D,0   }                                 \
+   }
+#endif
+
 #include "keymap_ergodox.h"
 
 
@@ -104,3 +149,24 @@ action_t keymap_fn_to_action(uint8_t keycode)
     return action;
 }
 
+#ifdef COMBO_ENABLE
+#define COMBO_ACTIONS_SIZE (sizeof(combo_actions) / sizeof(combo_actions[0]))
+
+/* combos the key is part of */
+combo_mask_t keymap_key_to_combos(keypos_t key)
+{
+    return pgm_read_word(&combomap[(key.row)][(key.col)]);
+}
+
+/* translates combo id to action */
+action_t keymap_combo_to_action(uint8_t id)
+{
+    action_t action;
+    if (id < COMBO_ACTIONS_SIZE) {
+        action.code = pgm_read_word(&combo_actions[id]);
+    } else {
+        action = (action_t)ACTION_NO;
+    }
+    return action;
+}
+#endif
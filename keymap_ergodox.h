@@ -92,6 +92,37 @@ const uint8_t keymaps[][MATRIX_ROWS][MATRIX_COLS] PROGMEM = {
     */
 };
 
+#ifdef COMBO_ENABLE
+/*
+ * Combo definition
+ */
+const combo_mask_t combomap[MATRIX_ROWS][MATRIX_COLS] PROGMEM =
+    COMBOMAP(
+        // left hand
+        0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,
+                                      0,   0,
+                                           0,
+                                 0,   0,   0,
+        // right hand
+             0,   0,   0,   0,   0,   0,   0,
+             0,   0,   0,   0,   0,   0,   0,
+                  0,   COMBO_BIT(0),COMBO_BIT(0),0,0,0,   // J+K
+             0,   0,   0,   0,   0,   0,   0,
+                       0,   0,   0,   0,   0,
+        0,   0,
+        0,
+        0,   0,   0
+    );
+
+const action_t combo_actions[] PROGMEM = {
+    ACTION_KEY(KC_ESC),                             // J+K - Escape
+};
+#endif
+
 /* id for user defined functions */
 #define TEENSY_KEY 0
 
@@ -112,7 +143,7 @@ void action_function(keyrecord_t *event, uint8_t id, uint8_t opt)
     if (id == TEENSY_KEY) {
         clear_keyboard();
         print("\n\nJump to bootloader... ");
-        _delay_ms(250);
+        wait_ms(250);
         bootloader_jump(); // should not return
         print("not supported.\n");
     }
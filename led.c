@@ -16,7 +16,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdint.h>
-#include <avr/io.h>
 #include "print.h"
 #include "debug.h"
 #include "led.h"
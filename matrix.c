@@ -20,15 +20,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <stdint.h>
 #include <stdbool.h>
-#include <avr/io.h>
-#include <util/delay.h>
+#include "wait.h"
 #include "action_layer.h"
 #include "print.h"
 #include "debug.h"
 #include "util.h"
 #include "matrix.h"
 #include "ergodox.h"
-#include "i2cmaster.h"
+#include "suspend.h"
 #ifdef DEBUG_MATRIX_SCAN_RATE
 #include  "timer.h"
 #endif
@@ -50,13 +49,13 @@ static matrix_row_t matrix[MATRIX_ROWS];
 // has recently changed and needs to calm down first, so the change is ignored.
 static matrix_row_t matrix_debouncing[DEBOUNCE][MATRIX_ROWS];
 
-static matrix_row_t read_cols(uint8_t row);
 static void init_cols(void);
 static void unselect_rows();
 static void select_row(uint8_t row);
 static matrix_row_t read_row_cols(uint8_t row);
 
 static uint8_t mcp23018_reset_loop;
+static uint16_t mcp23018_errors;
 
 #ifdef DEBUG_MATRIX_SCAN_RATE
 uint32_t matrix_timer;
@@ -124,6 +123,8 @@ inline static void advance_debouncing_matrix() {
 
 uint8_t matrix_scan(void)
 {
+    ergodox_blink_task();
+
     if (mcp23018_status) { // if there was an error
         if (++mcp23018_reset_loop == 0) {
             // since mcp23018_reset_loop is 8 bit - we'll try to reset once in 255 matrix scans
@@ -131,6 +132,7 @@ uint8_t matrix_scan(void)
             print("trying to reset mcp23018\n");
             mcp23018_status = init_mcp23018();
             if (mcp23018_status) {
+                mcp23018_errors++;
                 print("left side not responding\n");
             } else {
                 print("left side attached\n");
@@ -220,6 +222,11 @@ void matrix_print(void)
     }
 }
 
+uint16_t matrix_errors(void)
+{
+    return mcp23018_errors;
+}
+
 uint8_t matrix_key_count(void)
 {
     uint8_t count = 0;
@@ -246,8 +253,23 @@ static void  init_cols(void)
 
     // init on teensy
     // Input with pull-up(DDR:0, PORT:1)
-    DDRF  &= ~(1<<7 | 1<<6 | 1<<5 | 1<<4 | 1<<1 | 1<<0);
-    PORTF |=  (1<<7 | 1<<6 | 1<<5 | 1<<4 | 1<<1 | 1<<0);
+    gpio_set_input_pullup(COL0_PIN);
+    gpio_set_input_pullup(COL1_PIN);
+    gpio_set_input_pullup(COL2_PIN);
+    gpio_set_input_pullup(COL3_PIN);
+    gpio_set_input_pullup(COL4_PIN);
+    gpio_set_input_pullup(COL5_PIN);
+}
+
+// columns on teensy(1:on, 0:off)
+static inline uint8_t read_cols(void)
+{
+    return (gpio_read(COL0_PIN) ? 0 : (1<<0)) |
+           (gpio_read(COL1_PIN) ? 0 : (1<<1)) |
+           (gpio_read(COL2_PIN) ? 0 : (1<<2)) |
+           (gpio_read(COL3_PIN) ? 0 : (1<<3)) |
+           (gpio_read(COL4_PIN) ? 0 : (1<<4)) |
+           (gpio_read(COL5_PIN) ? 0 : (1<<5));
 }
 
 static inline matrix_row_t read_row_cols(uint8_t row) {
@@ -259,71 +281,29 @@ static inline matrix_row_t read_row_cols(uint8_t row) {
         } else {
             // set active row low  : 0
             // set other rows hi-Z : 1
-            mcp23018_status = i2c_start(I2C_ADDR_WRITE);        if (mcp23018_status) goto out;
-            mcp23018_status = i2c_write(GPIOA);                 if (mcp23018_status) goto out;
-            mcp23018_status = i2c_write(~(1<<row));             if (mcp23018_status) goto out;
-
-            uint8_t data = 0;
             // restart and read data from GPIOB, probably because it was automatically selected due to BANK=0?
-            mcp23018_status = i2c_start(I2C_ADDR_READ);     if (mcp23018_status) goto out;
+            uint8_t select[] = { GPIOA, (uint8_t)~(1<<row) };
+            uint8_t data = 0xFF;
 
             // read only one byte of data
-            data = i2c_readNak();
+            mcp23018_status = ergodox_i2c_write_read(I2C_ADDR, select, sizeof(select), &data, 1);
+            if (mcp23018_status) {
+                mcp23018_errors++;
+                return 0;
+            }
 
             // invert the result
-            data = ~data;
-
-        out:
-            i2c_stop();
-            return data;
+            return (uint8_t)~data;
         }
     }
 
     // other rows are directly attached to the controller
     // Output low(DDR:1, PORT:0) to select
-    switch (row) {
-        case 7:
-            DDRB  |= (1<<0);
-            PORTB &= ~(1<<0);
-            break;
-        case 8:
-            DDRB  |= (1<<1);
-            PORTB &= ~(1<<1);
-            break;
-        case 9:
-            DDRB  |= (1<<2);
-            PORTB &= ~(1<<2);
-            break;
-        case 10:
-            DDRB  |= (1<<3);
-            PORTB &= ~(1<<3);
-            break;
-        case 11:
-            DDRD  |= (1<<2);
-            PORTD &= ~(1<<2);
-            break;
-        case 12:
-            DDRD  |= (1<<3);
-            PORTD &= ~(1<<3);
-            break;
-        case 13:
-            DDRC  |= (1<<6);
-            PORTC &= ~(1<<6);
-            break;
-    }
+    select_row(row);
 
     // read input once, after a brief delay
-    _delay_us(5);
-    uint8_t v = PINF;
-    uint8_t result;
-
-    // lowest two bits are F0 and F1
-    result = (v & ( (1<<PINF0) | (1<<PINF1) ));
-
-    // bits 2-5 are F4-F7
-    result |= (( v & ( (1<<PINF4) | (1<<PINF5) | (1<<PINF6) | (1<<PINF7) )) >> 2);
-
-    return ~result;
+    wait_us(5);
+    return read_cols();
 }
 
 /* Row pin configuration
@@ -340,10 +320,69 @@ static void unselect_rows(void)
 {
     // unselect on teensy
     // Hi-Z(DDR:0, PORT:0) to unselect
-    DDRB  &= ~(1<<0 | 1<<1 | 1<<2 | 1<<3);
-    PORTB &= ~(1<<0 | 1<<1 | 1<<2 | 1<<3);
-    DDRD  &= ~(1<<2 | 1<<3);
-    PORTD &= ~(1<<2 | 1<<3);
-    DDRC  &= ~(1<<6);
-    PORTC &= ~(1<<6);
+    gpio_set_input(ROW7_PIN);
+    gpio_set_input(ROW8_PIN);
+    gpio_set_input(ROW9_PIN);
+    gpio_set_input(ROW10_PIN);
+    gpio_set_input(ROW11_PIN);
+    gpio_set_input(ROW12_PIN);
+    gpio_set_input(ROW13_PIN);
+}
+
+static void select_row(uint8_t row)
+{
+    switch (row) {
+        case 7:  gpio_set_output_low(ROW7_PIN);  break;
+        case 8:  gpio_set_output_low(ROW8_PIN);  break;
+        case 9:  gpio_set_output_low(ROW9_PIN);  break;
+        case 10: gpio_set_output_low(ROW10_PIN); break;
+        case 11: gpio_set_output_low(ROW11_PIN); break;
+        case 12: gpio_set_output_low(ROW12_PIN); break;
+        case 13: gpio_set_output_low(ROW13_PIN); break;
+    }
+}
+
+/* Suspend
+ *
+ * All rows are parked low on both halves while suspended, so that one read
+ * of columns tells whether any key is pressed instead of a full scan on each
+ * watchdog wakeup. Columns can't wake MCU by interrupt: PORTF has no pin
+ * change interrupt and INTA/B of MCP23018 are not connected to Teensy.
+ */
+static bool rows_parked = false;
+
+void matrix_power_down(void)
+{
+    // Teensy rows output low
+    for (uint8_t row = 7; row < MATRIX_ROWS; row++) {
+        select_row(row);
+    }
+    rows_parked = true;
+}
+
+void matrix_power_up(void)
+{
+    if (!rows_parked) return;
+    unselect_rows();
+    rows_parked = false;
+}
+
+bool suspend_wakeup_condition(void)
+{
+    if (!rows_parked) matrix_power_down();
+
+    wait_us(5);
+    bool pressed = read_cols();
+
+    // MCP23018 rows low and read columns in a transaction
+    if (!pressed && !mcp23018_status) {
+        static const uint8_t select[] = { GPIOA, 0b00000000 };
+        uint8_t data = 0xFF;
+        mcp23018_status = ergodox_i2c_write_read(I2C_ADDR, select, sizeof(select), &data, 1);
+        if (mcp23018_status) mcp23018_errors++;
+        pressed = (~data & 0b00111111);
+    }
+
+    if (pressed) matrix_power_up();
+    return pressed;
 }
@@ -36,6 +36,18 @@ ifeq (yes,$(strip $(BOOTMAGIC_ENABLE)))
     OPT_DEFS += -DBOOTMAGIC_ENABLE
 endif
 
+ifeq (yes,$(strip $(ADAPTIVE_TAPPING_ENABLE)))
+    ifneq (yes,$(strip $(BOOTMAGIC_ENABLE)))
+	SRC += $(COMMON_DIR)/avr/eeconfig.c
+    endif
+    OPT_DEFS += -DADAPTIVE_TAPPING_ENABLE
+endif
+
+ifeq (yes,$(strip $(COMBO_ENABLE)))
+    SRC += $(COMMON_DIR)/action_combo.c
+    OPT_DEFS += -DCOMBO_ENABLE
+endif
+
 ifeq (yes,$(strip $(MOUSEKEY_ENABLE)))
     SRC += $(COMMON_DIR)/mousekey.c
     OPT_DEFS += -DMOUSEKEY_ENABLE
@@ -58,8 +70,16 @@ ifeq (yes,$(strip $(COMMAND_ENABLE)))
     OPT_DEFS += -DCOMMAND_ENABLE
 endif
 
+ifeq (yes,$(strip $(RAW_ENABLE)))
+    SRC += $(COMMON_DIR)/raw_hid.c
+    OPT_DEFS += -DRAW_ENABLE
+endif
+
 ifeq (yes,$(strip $(NKRO_ENABLE)))
     OPT_DEFS += -DNKRO_ENABLE
+    ifeq (yes,$(strip $(NKRO_SHARED_ENABLE)))
+	OPT_DEFS += -DNKRO_SHARED_ENABLE
+    endif
 endif
 
 ifeq (yes,$(strip $(USB_6KRO_ENABLE)))
@@ -24,10 +24,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "action_layer.h"
 #include "action_tapping.h"
 #include "action_macro.h"
+#include "action_combo.h"
 #include "action_util.h"
 #include "action.h"
 #include "hook.h"
-#include "wait.h"
+#include "timer.h"
 
 #ifdef DEBUG_ACTION
 #include "debug.h"
@@ -44,28 +45,62 @@ void action_exec(keyevent_t event)
         hook_matrix_change(event);
     }
 
+    if (action_combo_process(event)) return;
+
+#ifndef NO_ACTION_TAPPING
+    keyrecord_t *record = action_tapping_slot();
+    *record = (keyrecord_t){ .event = event };
+    process_record(record);
+#else
     keyrecord_t record = { .event = event };
+    process_record(&record);
+#endif
+}
 
+/* pass record to tapping and action */
+void process_record(keyrecord_t *record)
+{
 #ifndef NO_ACTION_TAPPING
     action_tapping_process(record);
 #else
-    process_action(&record);
-    if (!IS_NOEVENT(record.event)) {
-        dprint("processed: "); debug_record(record); dprintln();
+    process_action(record);
+    if (!IS_NOEVENT(record->event)) {
+        dprint("processed: "); debug_record(*record); dprintln();
     }
 #endif
 }
 
 void process_action(keyrecord_t *record)
+{
+    keyevent_t event = record->event;
+
+    if (IS_NOEVENT(event)) { return; }
+
+    action_t action = record_action(record);
+    layer_switch_record_action(event, action);
+    process_action_with(record, action);
+}
+
+/* Action of the record is resolved once on first use and reused by later
+ * stages. Not on entry to action_exec() since events held in waiting_buffer
+ * must see layer state changed by the tap key they are waiting for. */
+action_t record_action(keyrecord_t *record)
+{
+    if (!record->resolved) {
+        record->action = layer_switch_event_action(record->event);
+        record->resolved = true;
+    }
+    return record->action;
+}
+
+/* execute action for the record, also used by combo */
+void process_action_with(keyrecord_t *record, action_t action)
 {
     keyevent_t event = record->event;
 #ifndef NO_ACTION_TAPPING
     uint8_t tap_count = record->tap.count;
 #endif
 
-    if (IS_NOEVENT(event)) { return; }
-
-    action_t action = layer_switch_get_action(event.key);
     dprint("ACTION: "); debug_action(action);
 #ifndef NO_ACTION_LAYER
     dprint(" layer_state: "); layer_debug();
@@ -73,6 +108,13 @@ void process_action(keyrecord_t *record)
 #endif
     dprintln();
 
+#ifndef NO_ACTION_MACRO
+    // key press stops macro playback
+    if (event.pressed && action.kind.id != ACT_MACRO && action_macro_playing()) {
+        action_macro_cancel();
+    }
+#endif
+
     switch (action.kind.id) {
         /* Key and Mods */
         case ACT_LMODS:
@@ -349,48 +391,79 @@ void process_action(keyrecord_t *record)
 
 
 
-/*
- * Utilities for actions.
+#ifdef LOCKING_SUPPORT_ENABLE
+/* Locking key emulation
+ *
+ * Lock key is pressed at once and released by action_locking_task() after
+ * LOCKING_KEY_DELAY, so that other keys are not held up meanwhile. Switch
+ * change while the lock key is still down is carried out after its release.
  */
-void register_code(uint8_t code)
+static const uint8_t locking_code[] = { KC_CAPSLOCK, KC_NUMLOCK, KC_SCROLLLOCK };
+#ifdef LOCKING_RESYNC_ENABLE
+static const uint8_t locking_led[]  = { USB_LED_CAPS_LOCK, USB_LED_NUM_LOCK, USB_LED_SCROLL_LOCK };
+#endif
+static struct {
+    uint16_t time;      // when lock key was pressed
+    bool     down   :1;
+    bool     queued :1; // switch changed while down
+    bool     on     :1; // state of switch
+} locking[3];
+
+static void locking_press(uint8_t i)
 {
-    if (code == KC_NO) {
-        return;
-    }
-
-#ifdef LOCKING_SUPPORT_ENABLE
-    else if (KC_LOCKING_CAPS == code) {
 #ifdef LOCKING_RESYNC_ENABLE
-        // Resync: ignore if caps lock already is on
-        if (host_keyboard_leds() & (1<<USB_LED_CAPS_LOCK)) return;
+    // Resync: ignore if lock state already matches switch
+    if (!(host_keyboard_leds() & (1<<locking_led[i])) == !locking[i].on) return;
 #endif
-        add_key(KC_CAPSLOCK);
-        send_keyboard_report();
-        wait_ms(100);
-        del_key(KC_CAPSLOCK);
-        send_keyboard_report();
-    }
+    add_key(locking_code[i]);
+    send_keyboard_report();
+    locking[i].time = timer_read();
+    locking[i].down = true;
+}
 
-    else if (KC_LOCKING_NUM == code) {
+static void locking_toggle(uint8_t i, bool on)
+{
+    locking[i].on = on;
+    if (locking[i].down) {
 #ifdef LOCKING_RESYNC_ENABLE
-        if (host_keyboard_leds() & (1<<USB_LED_NUM_LOCK)) return;
+        locking[i].queued = true;
+#else
+        locking[i].queued = !locking[i].queued;
 #endif
-        add_key(KC_NUMLOCK);
-        send_keyboard_report();
-        wait_ms(100);
-        del_key(KC_NUMLOCK);
-        send_keyboard_report();
+    } else {
+        locking_press(i);
     }
+}
 
-    else if (KC_LOCKING_SCROLL == code) {
-#ifdef LOCKING_RESYNC_ENABLE
-        if (host_keyboard_leds() & (1<<USB_LED_SCROLL_LOCK)) return;
-#endif
-        add_key(KC_SCROLLLOCK);
-        send_keyboard_report();
-        wait_ms(100);
-        del_key(KC_SCROLLLOCK);
+void action_locking_task(void)
+{
+    for (uint8_t i = 0; i < 3; i++) {
+        if (!locking[i].down || timer_elapsed(locking[i].time) < LOCKING_KEY_DELAY) continue;
+
+        del_key(locking_code[i]);
         send_keyboard_report();
+        locking[i].down = false;
+        if (locking[i].queued) {
+            locking[i].queued = false;
+            locking_press(i);
+        }
+    }
+}
+#endif
+
+
+/*
+ * Utilities for actions.
+ */
+void register_code(uint8_t code)
+{
+    if (code == KC_NO) {
+        return;
+    }
+
+#ifdef LOCKING_SUPPORT_ENABLE
+    else if (KC_LOCKING_CAPS <= code && code <= KC_LOCKING_SCROLL) {
+        locking_toggle(code - KC_LOCKING_CAPS, true);
     }
 #endif
 
@@ -437,38 +510,8 @@ void unregister_code(uint8_t code)
     }
 
 #ifdef LOCKING_SUPPORT_ENABLE
-    else if (KC_LOCKING_CAPS == code) {
-#ifdef LOCKING_RESYNC_ENABLE
-        // Resync: ignore if caps lock already is off
-        if (!(host_keyboard_leds() & (1<<USB_LED_CAPS_LOCK))) return;
-#endif
-        add_key(KC_CAPSLOCK);
-        send_keyboard_report();
-        wait_ms(100);
-        del_key(KC_CAPSLOCK);
-        send_keyboard_report();
-    }
-
-    else if (KC_LOCKING_NUM == code) {
-#ifdef LOCKING_RESYNC_ENABLE
-        if (!(host_keyboard_leds() & (1<<USB_LED_NUM_LOCK))) return;
-#endif
-        add_key(KC_NUMLOCK);
-        send_keyboard_report();
-        wait_ms(100);
-        del_key(KC_NUMLOCK);
-        send_keyboard_report();
-    }
-
-    else if (KC_LOCKING_SCROLL == code) {
-#ifdef LOCKING_RESYNC_ENABLE
-        if (!(host_keyboard_leds() & (1<<USB_LED_SCROLL_LOCK))) return;
-#endif
-        add_key(KC_SCROLLLOCK);
-        send_keyboard_report();
-        wait_ms(100);
-        del_key(KC_SCROLLLOCK);
-        send_keyboard_report();
+    else if (KC_LOCKING_CAPS <= code && code <= KC_LOCKING_SCROLL) {
+        locking_toggle(code - KC_LOCKING_CAPS, false);
     }
 #endif
 
@@ -525,10 +568,8 @@ void clear_keyboard_but_mods(void)
 #endif
 }
 
-bool is_tap_key(keypos_t key)
+static bool is_tap_action(action_t action)
 {
-    action_t action = layer_switch_get_action(key);
-
     switch (action.kind.id) {
         case ACT_LMODS_TAP:
         case ACT_RMODS_TAP:
@@ -548,6 +589,16 @@ bool is_tap_key(keypos_t key)
     return false;
 }
 
+bool is_tap_key(keypos_t key)
+{
+    return is_tap_action(layer_switch_get_action(key));
+}
+
+bool is_tap_record(keyrecord_t *record)
+{
+    return is_tap_action(record_action(record));
+}
+
 
 /*
  * debug print
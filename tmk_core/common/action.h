@@ -29,6 +29,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 extern "C" {
 #endif
 
+/* period locking key emulation holds lock key down(ms) */
+#ifndef LOCKING_KEY_DELAY
+#define LOCKING_KEY_DELAY   100
+#endif
+
 /* tapping count and state */
 typedef struct {
     bool    interrupted :1;
@@ -44,6 +49,8 @@ typedef struct {
 #ifndef NO_ACTION_TAPPING
     tap_t tap;
 #endif
+    bool        resolved;
+    action_t    action;     // valid when resolved
 } keyrecord_t;
 
 /* Execute action per keyevent */
@@ -59,7 +66,10 @@ const macro_t *action_get_macro(keyrecord_t *record, uint8_t id, uint8_t opt);
 void action_function(keyrecord_t *record, uint8_t id, uint8_t opt);
 
 /* Utilities for actions.  */
+void process_record(keyrecord_t *record);
 void process_action(keyrecord_t *record);
+void process_action_with(keyrecord_t *record, action_t action);
+action_t record_action(keyrecord_t *record);
 void register_code(uint8_t code);
 void unregister_code(uint8_t code);
 void register_mods(uint8_t mods);
@@ -69,6 +79,14 @@ void clear_keyboard(void);
 void clear_keyboard_but_mods(void);
 void layer_switch(uint8_t new_layer);
 bool is_tap_key(keypos_t key);
+bool is_tap_record(keyrecord_t *record);
+
+#ifdef LOCKING_SUPPORT_ENABLE
+/* release lock keys, called from keyboard_task() */
+void action_locking_task(void);
+#else
+#define action_locking_task()
+#endif
 
 /* debug */
 void debug_event(keyevent_t event);
@@ -0,0 +1,185 @@
+/*
+Copyright 2026 Alexander Neumann <alexander@bumpern.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "action.h"
+#include "action_combo.h"
+#include "matrix.h"
+#include "timer.h"
+
+#ifdef DEBUG_ACTION
+#include "debug.h"
+#else
+#include "nodebug.h"
+#endif
+
+
+/* Combo
+ *
+ * Keys pressed within COMBO_TERM are held here while they can still make
+ * up a combo. Keymap gives set of combos for each key, so that candidates
+ * are narrowed by AND of the sets on each press. When every key of a
+ * candidate is pressed and no larger candidate remains the combo action is
+ * executed, otherwise the held events go to tapping as usual in order.
+ * Per-event cost is bounded by COMBO_KEYS_MAX, COMBO_HELD_MAX and COMBO_MAX.
+ *
+ * Pending presses are the keys down since the first key of the combo, as
+ * seen by action_exec(). They are used instead of matrix_is_on() so that
+ * matching follows event order even when events lag the matrix(debounce,
+ * scan thread on ChibiOS).
+ */
+static keyevent_t pending[COMBO_KEYS_MAX];
+static uint8_t pending_count = 0;
+static combo_mask_t alive = 0;
+
+/* keys of fired combos still pressed */
+#define COMBO_RELEASED  0xFF
+static struct {
+    keypos_t key;
+    uint8_t  id;
+} held[COMBO_HELD_MAX];
+static uint8_t held_count = 0;
+
+/* number of keys of each combo */
+static uint8_t combo_size[COMBO_MAX];
+
+
+void action_combo_init(void)
+{
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            combo_mask_t combos = keymap_key_to_combos((keypos_t){ .row = row, .col = col });
+            for (uint8_t id = 0; combos; id++, combos >>= 1) {
+                if (combos & 1) combo_size[id]++;
+            }
+        }
+    }
+}
+
+/* candidates whose keys are all pending */
+static combo_mask_t combo_complete(void)
+{
+    combo_mask_t complete = 0;
+    for (uint8_t id = 0; id < COMBO_MAX; id++) {
+        if ((alive & COMBO_BIT(id)) && combo_size[id] == pending_count) {
+            complete |= COMBO_BIT(id);
+        }
+    }
+    return complete;
+}
+
+static void combo_action(uint8_t id, keyevent_t event)
+{
+    keyrecord_t record = { .event = event };
+    process_action_with(&record, keymap_combo_to_action(id));
+}
+
+/* fire combo if complete, or pass pending events through */
+static void combo_resolve(void)
+{
+    combo_mask_t complete = combo_complete();
+
+    if (complete && held_count + pending_count <= COMBO_HELD_MAX) {
+        uint8_t id = 0;
+        while (!(complete & COMBO_BIT(id))) id++;
+        dprintf("COMBO: %u\n", id);
+        for (uint8_t i = 0; i < pending_count; i++) {
+            held[held_count].key = pending[i].key;
+            held[held_count].id = id;
+            held_count++;
+        }
+        combo_action(id, pending[pending_count - 1]);
+    } else {
+        for (uint8_t i = 0; i < pending_count; i++) {
+            keyrecord_t record = { .event = pending[i] };
+            process_record(&record);
+        }
+    }
+    pending_count = 0;
+    alive = 0;
+}
+
+/* combo is released with the first of its keys */
+static bool combo_release(keyevent_t event)
+{
+    for (uint8_t i = 0; i < held_count; i++) {
+        if (!KEYEQ(held[i].key, event.key)) continue;
+
+        uint8_t id = held[i].id;
+        held[i] = held[--held_count];
+        if (id != COMBO_RELEASED) {
+            for (uint8_t j = 0; j < held_count; j++) {
+                if (held[j].id == id) held[j].id = COMBO_RELEASED;
+            }
+            combo_action(id, event);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool action_combo_process(keyevent_t event)
+{
+    if (IS_NOEVENT(event)) {
+        if (pending_count && TIMER_DIFF_16(event.time, pending[0].time) >= COMBO_TERM) {
+            combo_resolve();
+        }
+        return false;
+    }
+
+    if (!event.pressed) {
+        // keep order of events
+        if (pending_count) combo_resolve();
+        return combo_release(event);
+    }
+
+    combo_mask_t combos = keymap_key_to_combos(event.key);
+    if (pending_count) {
+        if (!(alive & combos) || pending_count == COMBO_KEYS_MAX ||
+                TIMER_DIFF_16(event.time, pending[0].time) >= COMBO_TERM) {
+            combo_resolve();
+        }
+    }
+    if (pending_count) {
+        alive &= combos;
+    } else {
+        if (!combos) return false;
+        alive = combos;
+    }
+    pending[pending_count++] = event;
+
+    // fire now unless larger combo is still possible
+    combo_mask_t complete = combo_complete();
+    if (complete && !(alive & ~complete)) {
+        combo_resolve();
+    }
+    return true;
+}
+
+
+/* no combo by default */
+__attribute__ ((weak))
+combo_mask_t keymap_key_to_combos(keypos_t key)
+{
+    (void)key;
+    return 0;
+}
+
+__attribute__ ((weak))
+action_t keymap_combo_to_action(uint8_t id)
+{
+    (void)id;
+    return (action_t)ACTION_NO;
+}
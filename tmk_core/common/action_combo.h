@@ -0,0 +1,62 @@
+/*
+Copyright 2026 Alexander Neumann <alexander@bumpern.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef ACTION_COMBO_H
+#define ACTION_COMBO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "keyboard.h"
+#include "action_code.h"
+
+
+/* period to press all keys of combo(ms) */
+#ifndef COMBO_TERM
+#define COMBO_TERM      50
+#endif
+
+/* max number of keys in a combo */
+#ifndef COMBO_KEYS_MAX
+#define COMBO_KEYS_MAX  4
+#endif
+
+/* max number of keys of fired combos held at once */
+#ifndef COMBO_HELD_MAX
+#define COMBO_HELD_MAX  8
+#endif
+
+/* set of combo ids, up to 16 combos */
+typedef uint16_t combo_mask_t;
+#define COMBO_MAX       16
+#define COMBO_BIT(id)   ((combo_mask_t)1<<(id))
+
+
+#ifdef COMBO_ENABLE
+/* combos the key is part of, defined in keymap(per-key combo index) */
+combo_mask_t keymap_key_to_combos(keypos_t key);
+
+/* action of combo, defined in keymap */
+action_t keymap_combo_to_action(uint8_t id);
+
+void action_combo_init(void);
+/* returns true when the event is held or consumed by combo */
+bool action_combo_process(keyevent_t event);
+#else
+#define action_combo_init()
+#define action_combo_process(event) false
+#endif
+
+#endif
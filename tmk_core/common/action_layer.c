@@ -3,6 +3,7 @@
 #include "action.h"
 #include "util.h"
 #include "action_layer.h"
+#include "matrix.h"
 #include "hook.h"
 
 #ifdef DEBUG_ACTION
@@ -24,7 +25,6 @@ static void default_layer_state_set(uint32_t state)
     default_layer_state = state;
     hook_default_layer_change(default_layer_state);
     default_layer_debug(); debug("\n");
-    clear_keyboard_but_mods(); // To avoid stuck keys
 }
 
 void default_layer_debug(void)
@@ -66,7 +66,6 @@ static void layer_state_set(uint32_t state)
     layer_state = state;
     hook_layer_change(layer_state);
     layer_debug(); dprintln();
-    clear_keyboard_but_mods(); // To avoid stuck keys
 }
 
 void layer_clear(void)
@@ -138,3 +137,34 @@ action_t layer_switch_get_action(keypos_t key)
     return action;
 #endif
 }
+
+
+/*
+ * Action of pressed keys
+ *
+ * Release of a key is processed with action recorded on its press so that
+ * layer change doesn't need to clear keyboard to avoid stuck keys.
+ */
+static action_t pressed_action[MATRIX_ROWS][MATRIX_COLS];
+static matrix_row_t pressed_recorded[MATRIX_ROWS];
+
+action_t layer_switch_event_action(keyevent_t event)
+{
+    if (!event.pressed && event.key.row < MATRIX_ROWS && event.key.col < MATRIX_COLS &&
+            (pressed_recorded[event.key.row] & ((matrix_row_t)1<<event.key.col))) {
+        return pressed_action[event.key.row][event.key.col];
+    }
+    return layer_switch_get_action(event.key);
+}
+
+void layer_switch_record_action(keyevent_t event, action_t action)
+{
+    if (event.key.row >= MATRIX_ROWS || event.key.col >= MATRIX_COLS) return;
+
+    if (event.pressed) {
+        pressed_action[event.key.row][event.key.col] = action;
+        pressed_recorded[event.key.row] |= ((matrix_row_t)1<<event.key.col);
+    } else {
+        pressed_recorded[event.key.row] &= ~((matrix_row_t)1<<event.key.col);
+    }
+}
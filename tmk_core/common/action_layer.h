@@ -74,4 +74,9 @@ void layer_xor(uint32_t state);
 /* return action depending on current layer status */
 action_t layer_switch_get_action(keypos_t key);
 
+/* return action of press depending on current layer status, or action recorded on press for release */
+action_t layer_switch_event_action(keyevent_t event);
+/* record action of press, or forget it on release */
+void layer_switch_record_action(keyevent_t event, action_t action);
+
 #endif
@@ -17,7 +17,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "action.h"
 #include "action_util.h"
 #include "action_macro.h"
-#include "wait.h"
+#include "timer.h"
+#include "host.h"
 
 #ifdef DEBUG_ACTION
 #include "debug.h"
@@ -28,30 +29,194 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #ifndef NO_ACTION_MACRO
 
+/* Macro player
+ *
+ * Macro is played from keyboard_task() one command per call instead of
+ * running inline with busy waits, so that matrix scan and USB keep going
+ * during long macro. WAIT and INTERVAL are measured with timer.
+ */
+static const macro_t *macro_queue[MACRO_QUEUE_SIZE];
+static uint8_t macro_queue_head = 0;
+static uint8_t macro_queue_tail = 0;
+
+static const macro_t *macro_p = 0;
+static uint8_t  macro_interval = 0;
+static uint8_t  macro_mod_storage = 0;
+static bool     macro_mod_stored = false;
+static uint8_t  macro_wait = 0;
+static uint16_t macro_wait_start = 0;
+
 #define MACRO_READ()  (macro = MACRO_GET(macro_p++))
-void action_macro_play(const macro_t *macro_p)
+
+static void macro_start(const macro_t *m)
+{
+    macro_p = m;
+    macro_interval = 0;
+    macro_mod_storage = 0;
+    macro_mod_stored = false;
+    macro_wait = 0;
+}
+
+#if defined(MACRO_PACKING_ENABLE) && defined(NKRO_ENABLE)
+/* Report packing
+ *
+ * With NKRO, strokes of macro without INTERVAL are packed into a report as
+ * long as the host still sees them in order. Hosts process NKRO bitmap from
+ * lower usage, so keys pressed in a report must be in ascending keycode order,
+ * a key can't change twice in a report and modifiers can't change once a key
+ * is pressed in the report. At most one report is sent per frame(1ms).
+ *
+ * Packed keys are added to report directly instead of register_code(), so
+ * they don't go through command_proc(). Oneshot modifiers still apply to and
+ * are cleared by the first packed report in send_keyboard_report().
+ */
+static struct {
+    bool     pending;
+    uint8_t  last_down;
+    uint8_t  changed[32];
+    uint16_t sent;
+} pack;
+
+#define PACK_CHANGED(k)     (pack.changed[(k)>>3] & (1<<((k)&7)))
+#define PACK_CHANGE(k)      (pack.changed[(k)>>3] |= (1<<((k)&7)))
+
+static bool pack_key(uint8_t code, bool pressed)
+{
+    if (IS_MOD(code)) {
+        if (pack.last_down) return false;
+        pressed ? add_weak_mods(MOD_BIT(code)) : del_weak_mods(MOD_BIT(code));
+    } else {
+        if (!IS_KEY(code) || (KC_LOCKING_CAPS <= code && code <= KC_LOCKING_SCROLL)) return false;
+        if (PACK_CHANGED(code)) return false;
+        if (pressed) {
+            if (code <= pack.last_down) return false;
+            pack.last_down = code;
+            add_key(code);
+        } else {
+            del_key(code);
+        }
+        PACK_CHANGE(code);
+    }
+    pack.pending = true;
+    return true;
+}
+
+static bool pack_mods(uint8_t mods)
+{
+    if (pack.last_down) return false;
+    set_mods(mods);
+    pack.pending = true;
+    return true;
+}
+
+static void pack_clear(void)
+{
+    pack.pending = false;
+    pack.last_down = 0;
+    for (uint8_t i = 0; i < sizeof(pack.changed); i++) pack.changed[i] = 0;
+}
+
+/* return false when command at macro_p can't be packed and no report is pending */
+static bool macro_pack(void)
 {
     macro_t macro = END;
-    uint8_t interval = 0;
 
-    uint8_t mod_storage = 0;
+    while (true) {
+        const macro_t *p = macro_p;
+        bool packed;
+        switch (MACRO_READ()) {
+            case KEY_DOWN:      MACRO_READ(); packed = pack_key(macro, true); break;
+            case KEY_UP:        MACRO_READ(); packed = pack_key(macro, false); break;
+            case 0x04 ... 0x73: packed = pack_key(macro, true); break;
+            case 0x84 ... 0xF3: packed = pack_key(macro&0x7F, false); break;
+            case MOD_STORE:     macro_mod_storage = get_mods(); macro_mod_stored = true; packed = true; break;
+            case MOD_RESTORE:   packed = pack_mods(macro_mod_storage); break;
+            case MOD_CLEAR:     packed = pack_mods(0); break;
+            default:            packed = false; break;
+        }
+        if (!packed) {
+            macro_p = p;
+            break;
+        }
+    }
+
+    if (!pack.pending) return false;
+
+    if (timer_read() != pack.sent) {
+        send_keyboard_report();
+        pack.sent = timer_read();
+        pack_clear();
+    }
+    return true;
+}
+#endif
+
+static void macro_step(void);
+
+/* play macro to the end at once, waiting inline like old macro player */
+static void macro_finish(void)
+{
+#if defined(MACRO_PACKING_ENABLE) && defined(NKRO_ENABLE)
+    if (pack.pending) send_keyboard_report();
+    pack_clear();
+#endif
+    while (macro_p) {
+        if (macro_wait) {
+            while (timer_elapsed(macro_wait_start) < macro_wait) ;
+            macro_wait = 0;
+        }
+        macro_step();
+    }
+}
+
+void action_macro_play(const macro_t *m)
+{
+    if (!m) return;
+
+    if (macro_p) {
+        uint8_t next = (macro_queue_head + 1) % MACRO_QUEUE_SIZE;
+        if (next == macro_queue_tail) {
+            /* queue full: finish macro playing and start oldest one to make room,
+             * dropping macro could leave its keys or modifiers held */
+            dprint("MACRO: queue full\n");
+            macro_finish();
+            macro_start(macro_queue[macro_queue_tail]);
+            macro_queue_tail = (macro_queue_tail + 1) % MACRO_QUEUE_SIZE;
+        }
+        macro_queue[macro_queue_head] = m;
+        macro_queue_head = next;
+        return;
+    }
+    macro_start(m);
+    action_macro_task();
+}
+
+bool action_macro_playing(void)
+{
+    return macro_p;
+}
+
+/* drop queued macros and release keys still held by the macro playing */
+void action_macro_cancel(void)
+{
+    macro_t macro = END;
 
+    macro_queue_tail = macro_queue_head;
+#if defined(MACRO_PACKING_ENABLE) && defined(NKRO_ENABLE)
+    pack_clear();
+#endif
     if (!macro_p) return;
+
+    dprint("MACRO: cancel\n");
     while (true) {
         switch (MACRO_READ()) {
             case KEY_DOWN:
+            case WAIT:
+            case INTERVAL:
                 MACRO_READ();
-                dprintf("KEY_DOWN(%02X)\n", macro);
-                if (IS_MOD(macro)) {
-                    add_weak_mods(MOD_BIT(macro));
-                    send_keyboard_report();
-                } else {
-                    register_code(macro);
-                }
                 break;
             case KEY_UP:
                 MACRO_READ();
-                dprintf("KEY_UP(%02X)\n", macro);
                 if (IS_MOD(macro)) {
                     del_weak_mods(MOD_BIT(macro));
                     send_keyboard_report();
@@ -59,40 +224,113 @@ void action_macro_play(const macro_t *macro_p)
                     unregister_code(macro);
                 }
                 break;
-            case WAIT:
-                MACRO_READ();
-                dprintf("WAIT(%u)\n", macro);
-                { uint8_t ms = macro; while (ms--) wait_ms(1); }
-                break;
-            case INTERVAL:
-                interval = MACRO_READ();
-                dprintf("INTERVAL(%u)\n", interval);
-                break;
             case MOD_STORE:
-                mod_storage = get_mods();
+                /* restore below would use state stored by the skipped store */
+                macro_mod_stored = false;
                 break;
             case MOD_RESTORE:
-                set_mods(mod_storage);
-                send_keyboard_report();
-                break;
-            case MOD_CLEAR:
-                clear_mods();
-                send_keyboard_report();
-                break;
-            case 0x04 ... 0x73:
-                dprintf("DOWN(%02X)\n", macro);
-                register_code(macro);
+                if (macro_mod_stored) {
+                    set_mods(macro_mod_storage);
+                    send_keyboard_report();
+                }
                 break;
             case 0x84 ... 0xF3:
-                dprintf("UP(%02X)\n", macro);
                 unregister_code(macro&0x7F);
                 break;
             case END:
-            default:
+                macro_p = 0;
                 return;
+            default:
+                break;
         }
-        // interval
-        { uint8_t ms = interval; while (ms--) wait_ms(1); }
     }
 }
+
+static void macro_step(void)
+{
+    macro_t macro = END;
+
+    switch (MACRO_READ()) {
+        case KEY_DOWN:
+            MACRO_READ();
+            dprintf("KEY_DOWN(%02X)\n", macro);
+            if (IS_MOD(macro)) {
+                add_weak_mods(MOD_BIT(macro));
+                send_keyboard_report();
+            } else {
+                register_code(macro);
+            }
+            break;
+        case KEY_UP:
+            MACRO_READ();
+            dprintf("KEY_UP(%02X)\n", macro);
+            if (IS_MOD(macro)) {
+                del_weak_mods(MOD_BIT(macro));
+                send_keyboard_report();
+            } else {
+                unregister_code(macro);
+            }
+            break;
+        case WAIT:
+            MACRO_READ();
+            dprintf("WAIT(%u)\n", macro);
+            macro_wait_start = timer_read();
+            macro_wait = macro;
+            return;
+        case INTERVAL:
+            macro_interval = MACRO_READ();
+            dprintf("INTERVAL(%u)\n", macro_interval);
+            break;
+        case MOD_STORE:
+            macro_mod_storage = get_mods();
+            macro_mod_stored = true;
+            break;
+        case MOD_RESTORE:
+            set_mods(macro_mod_storage);
+            send_keyboard_report();
+            break;
+        case MOD_CLEAR:
+            clear_mods();
+            send_keyboard_report();
+            break;
+        case 0x04 ... 0x73:
+            dprintf("DOWN(%02X)\n", macro);
+            register_code(macro);
+            break;
+        case 0x84 ... 0xF3:
+            dprintf("UP(%02X)\n", macro);
+            unregister_code(macro&0x7F);
+            break;
+        case END:
+        default:
+            macro_p = 0;
+            return;
+    }
+    // interval
+    if (macro_interval) {
+        macro_wait_start = timer_read();
+        macro_wait = macro_interval;
+    }
+}
+
+void action_macro_task(void)
+{
+    if (macro_wait) {
+        if (timer_elapsed(macro_wait_start) < macro_wait) return;
+        macro_wait = 0;
+    }
+
+    if (!macro_p) {
+        if (macro_queue_tail == macro_queue_head) return;
+        macro_start(macro_queue[macro_queue_tail]);
+        macro_queue_tail = (macro_queue_tail + 1) % MACRO_QUEUE_SIZE;
+    }
+
+#if defined(MACRO_PACKING_ENABLE) && defined(NKRO_ENABLE)
+    if (!macro_interval && keyboard_protocol && keyboard_nkro) {
+        if (macro_pack()) return;
+    }
+#endif
+    macro_step();
+}
 #endif
@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef ACTION_MACRO_H
 #define ACTION_MACRO_H
 #include <stdint.h>
+#include <stdbool.h>
 #include "progmem.h"
 
 
@@ -27,10 +28,26 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 typedef uint8_t macro_t;
 
 
+/* number of macros waiting for playback, when full the macro playing is
+ * finished at once to make room */
+#ifndef MACRO_QUEUE_SIZE
+#define MACRO_QUEUE_SIZE    4
+#endif
+
+
 #ifndef NO_ACTION_MACRO
+/* queue macro for playback by action_macro_task() */
 void action_macro_play(const macro_t *macro_p);
+/* advance playback, called from keyboard_task() */
+void action_macro_task(void);
+/* stop playback and drop queued macros */
+void action_macro_cancel(void);
+bool action_macro_playing(void);
 #else
 #define action_macro_play(macro)
+#define action_macro_task()
+#define action_macro_cancel()
+#define action_macro_playing()  false
 #endif
 
 
@@ -5,6 +5,10 @@
 #include "action_tapping.h"
 #include "keycode.h"
 #include "timer.h"
+#ifdef ADAPTIVE_TAPPING_ENABLE
+#include "eeconfig.h"
+#include "print.h"
+#endif
 
 #ifdef DEBUG_ACTION
 #include "debug.h"
@@ -18,54 +22,81 @@
 #define IS_TAPPING_PRESSED()    (IS_TAPPING() && tapping_key.event.pressed)
 #define IS_TAPPING_RELEASED()   (IS_TAPPING() && !tapping_key.event.pressed)
 #define IS_TAPPING_KEY(k)       (IS_TAPPING() && KEYEQ(tapping_key.event.key, (k)))
+#ifdef ADAPTIVE_TAPPING_ENABLE
+#define WITHIN_TAPPING_TERM(e)  (TIMER_DIFF_16(e.time, tapping_key.event.time) < tapping_term_get(tapping_key.event.key))
+#else
 #define WITHIN_TAPPING_TERM(e)  (TIMER_DIFF_16(e.time, tapping_key.event.time) < TAPPING_TERM)
+#endif
 
 
 static keyrecord_t tapping_key = {};
 static keyrecord_t waiting_buffer[WAITING_BUFFER_SIZE] = {};
 static uint8_t waiting_buffer_head = 0;
 static uint8_t waiting_buffer_tail = 0;
+#ifdef ADAPTIVE_TAPPING_ENABLE
+/* press of a tap key which was settled as hold by timeout without interruption */
+static keyevent_t adapt_hold = {};
+#endif
 
 static bool process_tapping(keyrecord_t *record);
-static bool waiting_buffer_enq(keyrecord_t record);
+static bool waiting_buffer_enq(void);
 static void waiting_buffer_clear(void);
+static void waiting_buffer_process(void);
+static bool waiting_buffer_settle(void);
 static bool waiting_buffer_typed(keyevent_t event);
 static void waiting_buffer_scan_tap(void);
 static void debug_tapping_key(void);
 static void debug_waiting_buffer(void);
+#ifdef ADAPTIVE_TAPPING_ENABLE
+static void tapping_adapt_event(keyevent_t event);
+static void tapping_adapt_tap(keypos_t key, uint16_t duration);
+static void tapping_adapt_task(void);
+#endif
+
 
+keyrecord_t *action_tapping_slot(void)
+{
+    return &waiting_buffer[waiting_buffer_head];
+}
 
-void action_tapping_process(keyrecord_t record)
+void action_tapping_process(keyrecord_t *record)
 {
-    if (process_tapping(&record)) {
-        if (!IS_NOEVENT(record.event)) {
-            debug("processed: "); debug_record(record); debug("\n");
+    bool noevent = IS_NOEVENT(record->event);
+#ifdef ADAPTIVE_TAPPING_ENABLE
+    tapping_adapt_event(record->event);
+#endif
+    // process in free slot at head so that enqueue needs no copy
+    keyrecord_t *slot = action_tapping_slot();
+    if (record != slot) *slot = *record;
+    if (process_tapping(slot)) {
+        if (!IS_NOEVENT(slot->event)) {
+            debug("processed: "); debug_record(*slot); debug("\n");
         }
     } else {
-        if (!waiting_buffer_enq(record)) {
-            // clear all in case of overflow.
-            debug("OVERFLOW: CLEAR ALL STATES\n");
-            clear_keyboard();
-            waiting_buffer_clear();
-            tapping_key = (keyrecord_t){};
+        while (!waiting_buffer_enq()) {
+            if (!waiting_buffer_settle()) {
+                // clear all in case of overflow.
+                debug("OVERFLOW: CLEAR ALL STATES\n");
+                clear_keyboard();
+                waiting_buffer_clear();
+                tapping_key = (keyrecord_t){};
+                break;
+            }
+            if (process_tapping(slot)) break;
         }
     }
 
     // process waiting_buffer
-    if (!IS_NOEVENT(record.event) && waiting_buffer_head != waiting_buffer_tail) {
+    if (!noevent && waiting_buffer_head != waiting_buffer_tail) {
         debug("---- action_exec: process waiting_buffer -----\n");
     }
-    for (; waiting_buffer_tail != waiting_buffer_head; waiting_buffer_tail = (waiting_buffer_tail + 1) % WAITING_BUFFER_SIZE) {
-        if (process_tapping(&waiting_buffer[waiting_buffer_tail])) {
-            debug("processed: waiting_buffer["); debug_dec(waiting_buffer_tail); debug("] = ");
-            debug_record(waiting_buffer[waiting_buffer_tail]); debug("\n\n");
-        } else {
-            break;
-        }
-    }
-    if (!IS_NOEVENT(record.event)) {
+    waiting_buffer_process();
+    if (!noevent) {
         debug("\n");
     }
+#ifdef ADAPTIVE_TAPPING_ENABLE
+    tapping_adapt_task();
+#endif
 }
 
 
@@ -86,6 +117,9 @@ bool process_tapping(keyrecord_t *keyp)
                 if (IS_TAPPING_KEY(event.key) && !event.pressed) {
                     // first tap!
                     debug("Tapping: First tap(0->1).\n");
+#ifdef ADAPTIVE_TAPPING_ENABLE
+                    tapping_adapt_tap(event.key, TIMER_DIFF_16(event.time, tapping_key.event.time));
+#endif
                     tapping_key.tap.count = 1;
                     debug_tapping_key();
                     process_action(&tapping_key);
@@ -115,7 +149,7 @@ bool process_tapping(keyrecord_t *keyp)
                  */
                 else if (IS_RELEASED(event) && !waiting_buffer_typed(event)) {
                     // Modifier should be retained till end of this tapping.
-                    action_t action = layer_switch_get_action(event.key);
+                    action_t action = record_action(keyp);
                     switch (action.kind.id) {
                         case ACT_LMODS:
                         case ACT_RMODS:
@@ -152,7 +186,7 @@ bool process_tapping(keyrecord_t *keyp)
                     debug_tapping_key();
                     return true;
                 }
-                else if (is_tap_key(event.key) && event.pressed) {
+                else if (event.pressed && is_tap_record(keyp)) {
                     if (tapping_key.tap.count > 1) {
                         debug("Tapping: Start new tap with releasing last tap(>1).\n");
                         // unregister key
@@ -184,6 +218,9 @@ bool process_tapping(keyrecord_t *keyp)
             if (tapping_key.tap.count == 0) {
                 debug("Tapping: End. Timeout. Not tap(0): ");
                 debug_event(event); debug("\n");
+#ifdef ADAPTIVE_TAPPING_ENABLE
+                if (!tapping_key.tap.interrupted) adapt_hold = tapping_key.event;
+#endif
                 process_action(&tapping_key);
                 tapping_key = (keyrecord_t){};
                 debug_tapping_key();
@@ -196,7 +233,7 @@ bool process_tapping(keyrecord_t *keyp)
                     tapping_key = (keyrecord_t){};
                     return true;
                 }
-                else if (is_tap_key(event.key) && event.pressed) {
+                else if (event.pressed && is_tap_record(keyp)) {
                     if (tapping_key.tap.count > 1) {
                         debug("Tapping: Start new tap with releasing last timeout tap(>1).\n");
                         // unregister key
@@ -241,7 +278,7 @@ bool process_tapping(keyrecord_t *keyp)
                         tapping_key = *keyp;
                         return true;
                     }
-                } else if (is_tap_key(event.key)) {
+                } else if (is_tap_record(keyp)) {
                     // Sequential tap can be interfered with other tap key.
                     debug("Tapping: Start with interfering other tap.\n");
                     tapping_key = *keyp;
@@ -272,7 +309,7 @@ bool process_tapping(keyrecord_t *keyp)
     }
     // not tapping state
     else {
-        if (event.pressed && is_tap_key(event.key)) {
+        if (event.pressed && is_tap_record(keyp)) {
             debug("Tapping: Start(Press tap key).\n");
             tapping_key = *keyp;
             waiting_buffer_scan_tap();
@@ -289,24 +326,50 @@ bool process_tapping(keyrecord_t *keyp)
 /*
  * Waiting buffer
  */
-bool waiting_buffer_enq(keyrecord_t record)
+/* enqueue record in the slot at head */
+bool waiting_buffer_enq(void)
 {
-    if (IS_NOEVENT(record.event)) {
+    if (IS_NOEVENT(waiting_buffer[waiting_buffer_head].event)) {
         return true;
     }
 
-    if ((waiting_buffer_head + 1) % WAITING_BUFFER_SIZE == waiting_buffer_tail) {
+    uint8_t next = (waiting_buffer_head + 1) & WAITING_BUFFER_MASK;
+    if (next == waiting_buffer_tail) {
         debug("waiting_buffer_enq: Over flow.\n");
         return false;
     }
-
-    waiting_buffer[waiting_buffer_head] = record;
-    waiting_buffer_head = (waiting_buffer_head + 1) % WAITING_BUFFER_SIZE;
+    waiting_buffer_head = next;
 
     debug("waiting_buffer_enq: "); debug_waiting_buffer();
     return true;
 }
 
+void waiting_buffer_process(void)
+{
+    for (; waiting_buffer_tail != waiting_buffer_head; waiting_buffer_tail = (waiting_buffer_tail + 1) & WAITING_BUFFER_MASK) {
+        if (process_tapping(&waiting_buffer[waiting_buffer_tail])) {
+            debug("processed: waiting_buffer["); debug_dec(waiting_buffer_tail); debug("] = ");
+            debug_record(waiting_buffer[waiting_buffer_tail]); debug("\n\n");
+        } else {
+            break;
+        }
+    }
+}
+
+/* On overflow settle the pending tap key as hold, which is what it is
+ * used for when this many keys are pressed during it, and replay buffer. */
+bool waiting_buffer_settle(void)
+{
+    if (!IS_TAPPING_PRESSED() || tapping_key.tap.count > 0) return false;
+
+    debug("OVERFLOW: settle tapping key as hold\n");
+    process_action(&tapping_key);
+    tapping_key = (keyrecord_t){};
+    debug_tapping_key();
+    waiting_buffer_process();
+    return true;
+}
+
 void waiting_buffer_clear(void)
 {
     waiting_buffer_head = 0;
@@ -315,7 +378,7 @@ void waiting_buffer_clear(void)
 
 bool waiting_buffer_typed(keyevent_t event)
 {
-    for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) % WAITING_BUFFER_SIZE) {
+    for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) & WAITING_BUFFER_MASK) {
         if (KEYEQ(event.key, waiting_buffer[i].event.key) && event.pressed !=  waiting_buffer[i].event.pressed) {
             return true;
         }
@@ -331,10 +394,14 @@ void waiting_buffer_scan_tap(void)
     // invalid state: tapping_key released && tap.count == 0
     if (!tapping_key.event.pressed) return;
 
-    for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) % WAITING_BUFFER_SIZE) {
+    for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) & WAITING_BUFFER_MASK) {
         if (IS_TAPPING_KEY(waiting_buffer[i].event.key) &&
                 !waiting_buffer[i].event.pressed &&
                 WITHIN_TAPPING_TERM(waiting_buffer[i].event)) {
+#ifdef ADAPTIVE_TAPPING_ENABLE
+            tapping_adapt_tap(tapping_key.event.key,
+                    TIMER_DIFF_16(waiting_buffer[i].event.time, tapping_key.event.time));
+#endif
             tapping_key.tap.count = 1;
             waiting_buffer[i].tap.count = 1;
             process_action(&tapping_key);
@@ -347,6 +414,163 @@ void waiting_buffer_scan_tap(void)
 }
 
 
+#ifdef ADAPTIVE_TAPPING_ENABLE
+/*
+ * Adaptive tapping term
+ *
+ * Tap duration is learned per dual-role key and interval between key presses
+ * globally with exponentially weighted moving average in 12.4 fixed point.
+ * Term of a key is
+ *
+ *   min(tap + 4 * tap_deviation, tap + interval)
+ *
+ * bounded with TAPPING_TERM_MIN and TAPPING_TERM_MAX. A press settled as hold
+ * by timeout and released with no other key pressed is learned as slow tap
+ * so that the term grows instead of keeping misfiring.
+ */
+#define ADAPT_MAGIC             (0xA0 | TAPPING_TERM_KEYS)
+#define ADAPT_FIX(ms)           ((uint16_t)(ms) << 4)
+#define ADAPT_EWMA(avg, x, sh)  ((avg) += ((int16_t)(x) - (int16_t)(avg)) >> (sh))
+
+typedef struct {
+    keypos_t key;
+    uint16_t tap;       // mean tap duration(ms, 12.4)
+    uint16_t dev;       // mean deviation of tap duration(ms, 12.4)
+} tapping_stat_t;
+
+static struct {
+    uint8_t  magic;
+    uint16_t interval;  // mean interval between presses(ms, 12.4)
+    tapping_stat_t stat[TAPPING_TERM_KEYS];
+} adapt;
+
+/* EEPROM is read and saved with uint8_t offset */
+_Static_assert(sizeof(adapt) <= UINT8_MAX, "TAPPING_TERM_KEYS is too large");
+
+static bool     adapt_loaded = false;
+static bool     adapt_dirty = false;
+static uint8_t  adapt_victim = 0;
+static uint8_t  adapt_save_pos = sizeof(adapt);
+static uint16_t adapt_last_press = 0;
+static uint32_t adapt_save_time = 0;
+
+static void tapping_adapt_load(void)
+{
+    adapt_loaded = true;
+    adapt_save_time = timer_read32();
+    eeconfig_read_tapping(&adapt, sizeof(adapt));
+    if (adapt.magic == ADAPT_MAGIC) {
+        return;
+    }
+
+    adapt.magic = ADAPT_MAGIC;
+    adapt.interval = ADAPT_FIX(TAPPING_TERM);
+    for (uint8_t i = 0; i < TAPPING_TERM_KEYS; i++) {
+        adapt.stat[i].key = (keypos_t){ .row = 255, .col = 255 };
+    }
+}
+
+static tapping_stat_t *tapping_adapt_find(keypos_t key)
+{
+    for (uint8_t i = 0; i < TAPPING_TERM_KEYS; i++) {
+        if (KEYEQ(adapt.stat[i].key, key)) return &adapt.stat[i];
+    }
+    return 0;
+}
+
+static uint16_t tapping_adapt_term(tapping_stat_t *s)
+{
+    uint16_t term = (s->tap >> 4) + (s->dev >> 2);
+    uint16_t cadence = (s->tap >> 4) + (adapt.interval >> 4);
+    if (cadence < term) term = cadence;
+
+    if (term < TAPPING_TERM_MIN) return TAPPING_TERM_MIN;
+    if (term > TAPPING_TERM_MAX) return TAPPING_TERM_MAX;
+    return term;
+}
+
+uint16_t tapping_term_get(keypos_t key)
+{
+    tapping_stat_t *s = tapping_adapt_find(key);
+    if (!s) return TAPPING_TERM;
+    return tapping_adapt_term(s);
+}
+
+static void tapping_adapt_tap(keypos_t key, uint16_t duration)
+{
+    if (duration >= TAPPING_TERM_MAX) return;
+
+    tapping_stat_t *s = tapping_adapt_find(key);
+    if (!s) {
+        // start from the state which gives TAPPING_TERM
+        s = &adapt.stat[adapt_victim];
+        adapt_victim = (adapt_victim + 1) % TAPPING_TERM_KEYS;
+        s->key = key;
+        s->tap = ADAPT_FIX(TAPPING_TERM) / 2;
+        s->dev = ADAPT_FIX(TAPPING_TERM) / 8;
+    }
+
+    uint16_t x = ADAPT_FIX(duration);
+    uint16_t d = (x > s->tap) ? x - s->tap : s->tap - x;
+    ADAPT_EWMA(s->tap, x, 3);
+    ADAPT_EWMA(s->dev, d, 2);
+    adapt_dirty = true;
+
+    debug("Tapping: adapt: "); debug_dec(duration); debug("ms term=");
+    debug_dec(tapping_adapt_term(s)); debug("\n");
+}
+
+static void tapping_adapt_event(keyevent_t event)
+{
+    if (!adapt_loaded) tapping_adapt_load();
+    if (IS_NOEVENT(event)) return;
+
+    if (event.pressed) {
+        uint16_t interval = TIMER_DIFF_16(event.time, adapt_last_press);
+        if (adapt_last_press && interval < TAPPING_TERM_MAX) {
+            ADAPT_EWMA(adapt.interval, ADAPT_FIX(interval), 4);
+            adapt_dirty = true;
+        }
+        adapt_last_press = event.time;
+        adapt_hold = (keyevent_t){};
+    } else if (!IS_NOEVENT(adapt_hold) && KEYEQ(event.key, adapt_hold.key)) {
+        tapping_adapt_tap(event.key, TIMER_DIFF_16(event.time, adapt_hold.time));
+        adapt_hold = (keyevent_t){};
+    }
+}
+
+/* write back one byte per call not to block while EEPROM is busy */
+static void tapping_adapt_task(void)
+{
+    if (adapt_save_pos < sizeof(adapt)) {
+        if (eeconfig_update_tapping(adapt_save_pos, ((uint8_t *)&adapt)[adapt_save_pos])) {
+            adapt_save_pos++;
+        }
+        return;
+    }
+
+    if (adapt_dirty && timer_elapsed32(adapt_save_time) > TAPPING_TERM_SAVE_INTERVAL) {
+        adapt_dirty = false;
+        adapt_save_pos = 0;
+        adapt_save_time = timer_read32();
+    }
+}
+
+void tapping_term_print(void)
+{
+    if (!adapt_loaded) tapping_adapt_load();
+
+    xprintf("\n\t- Tapping term -\ninterval: %u\n", adapt.interval >> 4);
+    for (uint8_t i = 0; i < TAPPING_TERM_KEYS; i++) {
+        tapping_stat_t *s = &adapt.stat[i];
+        if (s->key.row == 255) continue;
+        xprintf("%02X%02X: tap=%u dev=%u term=%u\n", s->key.row, s->key.col,
+                s->tap >> 4, s->dev >> 4, tapping_adapt_term(s));
+    }
+}
+#endif
+
+
 /*
  * debug print
  */
@@ -358,7 +582,7 @@ static void debug_tapping_key(void)
 static void debug_waiting_buffer(void)
 {
     debug("{ ");
-    for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) % WAITING_BUFFER_SIZE) {
+    for (uint8_t i = waiting_buffer_tail; i != waiting_buffer_head; i = (i + 1) & WAITING_BUFFER_MASK) {
         debug("["); debug_dec(i); debug("]="); debug_record(waiting_buffer[i]); debug(" ");
     }
     debug("}\n");
@@ -29,11 +29,47 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define TAPPING_TOGGLE  5
 #endif
 
+/* must be power of two */
 #define WAITING_BUFFER_SIZE 8
+#define WAITING_BUFFER_MASK (WAITING_BUFFER_SIZE - 1)
+#if (WAITING_BUFFER_SIZE & WAITING_BUFFER_MASK)
+#error "WAITING_BUFFER_SIZE must be power of two"
+#endif
+
+
+#ifdef ADAPTIVE_TAPPING_ENABLE
+/* bounds of adaptive tapping term(ms) */
+#ifndef TAPPING_TERM_MIN
+#define TAPPING_TERM_MIN    (TAPPING_TERM / 2)
+#endif
+#ifndef TAPPING_TERM_MAX
+#define TAPPING_TERM_MAX    (TAPPING_TERM * 2)
+#endif
+
+/* number of dual-role keys to learn */
+#ifndef TAPPING_TERM_KEYS
+#define TAPPING_TERM_KEYS   8
+#endif
+
+/* period of saving learned terms to EEPROM(ms) */
+#ifndef TAPPING_TERM_SAVE_INTERVAL
+#define TAPPING_TERM_SAVE_INTERVAL  600000
+#endif
+
+#if TAPPING_TERM_MAX > 1000
+#error "TAPPING_TERM_MAX must be 1000 or less"
+#endif
+#endif
 
 
 #ifndef NO_ACTION_TAPPING
-void action_tapping_process(keyrecord_t record);
+/* free slot of waiting buffer, a record built here is processed without copy */
+keyrecord_t *action_tapping_slot(void);
+void action_tapping_process(keyrecord_t *record);
+#ifdef ADAPTIVE_TAPPING_ENABLE
+uint16_t tapping_term_get(keypos_t key);
+void tapping_term_print(void);
+#endif
 #endif
 
 #endif
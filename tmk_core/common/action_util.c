@@ -30,14 +30,21 @@ static inline void del_key_bit(uint8_t code);
 static uint8_t real_mods = 0;
 static uint8_t weak_mods = 0;
 
+/* number of keys in report, kept by add/del so has_anykey() needn't scan it */
+static uint8_t key_count = 0;
+
 #ifdef USB_6KRO_ENABLE
-#define RO_ADD(a, b) ((a + b) % KEYBOARD_REPORT_KEYS)
-#define RO_SUB(a, b) ((a - b + KEYBOARD_REPORT_KEYS) % KEYBOARD_REPORT_KEYS)
-#define RO_INC(a) RO_ADD(a, 1)
-#define RO_DEC(a) RO_SUB(a, 1)
-static int8_t cb_head = 0;
-static int8_t cb_tail = 0;
-static int8_t cb_count = 0;
+/* 6KRO rollover
+ *
+ * Key stays in its slot of keys[] until released and slots in use are
+ * linked in order of press, so that the oldest key is replaced in constant
+ * time when report is full.
+ */
+#define RO_NONE -1
+static int8_t ro_next[KEYBOARD_REPORT_KEYS];
+static int8_t ro_prev[KEYBOARD_REPORT_KEYS];
+static int8_t ro_oldest = RO_NONE;
+static int8_t ro_newest = RO_NONE;
 #endif
 
 // TODO: pointer variable is not needed
@@ -101,6 +108,10 @@ void clear_keys(void)
     for (int8_t i = 1; i < KEYBOARD_REPORT_SIZE; i++) {
         keyboard_report->raw[i] = 0;
     }
+    key_count = 0;
+#ifdef USB_6KRO_ENABLE
+    ro_oldest = ro_newest = RO_NONE;
+#endif
 }
 
 
@@ -144,12 +155,7 @@ void clear_oneshot_mods(void)
  */
 uint8_t has_anykey(void)
 {
-    uint8_t cnt = 0;
-    for (uint8_t i = 1; i < KEYBOARD_REPORT_SIZE; i++) {
-        if (keyboard_report->raw[i])
-            cnt++;
-    }
-    return cnt;
+    return key_count;
 }
 
 uint8_t has_anymod(void)
@@ -168,14 +174,7 @@ uint8_t get_first_key(void)
     }
 #endif
 #ifdef USB_6KRO_ENABLE
-    uint8_t i = cb_head;
-    do {
-        if (keyboard_report->keys[i] != 0) {
-            break;
-        }
-        i = RO_INC(i);
-    } while (i != cb_tail);
-    return keyboard_report->keys[i];
+    return (ro_oldest == RO_NONE ? 0 : keyboard_report->keys[ro_oldest]);
 #else
     return keyboard_report->keys[0];
 #endif
@@ -184,112 +183,81 @@ uint8_t get_first_key(void)
 
 
 /* local functions */
-static inline void add_key_byte(uint8_t code)
-{
 #ifdef USB_6KRO_ENABLE
-    int8_t i = cb_head;
-    int8_t empty = -1;
-    if (cb_count) {
-        do {
-            if (keyboard_report->keys[i] == code) {
-                return;
-            }
-            if (empty == -1 && keyboard_report->keys[i] == 0) {
-                empty = i;
-            }
-            i = RO_INC(i);
-        } while (i != cb_tail);
-        if (i == cb_tail) {
-            if (cb_tail == cb_head) {
-                // buffer is full
-                if (empty == -1) {
-                    // pop head when has no empty space
-                    cb_head = RO_INC(cb_head);
-                    cb_count--;
-                }
-                else {
-                    // left shift when has empty space
-                    uint8_t offset = 1;
-                    i = RO_INC(empty);
-                    do {
-                        if (keyboard_report->keys[i] != 0) {
-                            keyboard_report->keys[empty] = keyboard_report->keys[i];
-                            keyboard_report->keys[i] = 0;
-                            empty = RO_INC(empty);
-                        }
-                        else {
-                            offset++;
-                        }
-                        i = RO_INC(i);
-                    } while (i != cb_tail);
-                    cb_tail = RO_SUB(cb_tail, offset);
-                }
-            }
-        }
+static inline void ro_link(int8_t i)
+{
+    ro_prev[i] = ro_newest;
+    ro_next[i] = RO_NONE;
+    if (ro_newest == RO_NONE) {
+        ro_oldest = i;
+    } else {
+        ro_next[ro_newest] = i;
     }
-    // add to tail
-    keyboard_report->keys[cb_tail] = code;
-    cb_tail = RO_INC(cb_tail);
-    cb_count++;
-#else
-    int8_t i = 0;
+    ro_newest = i;
+}
+
+static inline void ro_unlink(int8_t i)
+{
+    if (ro_prev[i] == RO_NONE) {
+        ro_oldest = ro_next[i];
+    } else {
+        ro_next[ro_prev[i]] = ro_next[i];
+    }
+    if (ro_next[i] == RO_NONE) {
+        ro_newest = ro_prev[i];
+    } else {
+        ro_prev[ro_next[i]] = ro_prev[i];
+    }
+}
+#endif
+
+static inline void add_key_byte(uint8_t code)
+{
     int8_t empty = -1;
-    for (; i < KEYBOARD_REPORT_KEYS; i++) {
+    for (int8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
         if (keyboard_report->keys[i] == code) {
-            break;
+            return;
         }
         if (empty == -1 && keyboard_report->keys[i] == 0) {
             empty = i;
         }
     }
-    if (i == KEYBOARD_REPORT_KEYS) {
-        if (empty != -1) {
-            keyboard_report->keys[empty] = code;
-        }
+#ifdef USB_6KRO_ENABLE
+    if (empty == -1) {
+        // replace oldest key when full
+        empty = ro_oldest;
+        ro_unlink(empty);
+        key_count--;
+    }
+    ro_link(empty);
+#else
+    if (empty == -1) {
+        return;
     }
 #endif
+    keyboard_report->keys[empty] = code;
+    key_count++;
 }
 
 static inline void del_key_byte(uint8_t code)
 {
-#ifdef USB_6KRO_ENABLE
-    uint8_t i = cb_head;
-    if (cb_count) {
-        do {
-            if (keyboard_report->keys[i] == code) {
-                keyboard_report->keys[i] = 0;
-                cb_count--;
-                if (cb_count == 0) {
-                    // reset head and tail
-                    cb_tail = cb_head = 0;
-                }
-                if (i == RO_DEC(cb_tail)) {
-                    // left shift when next to tail
-                    do {
-                        cb_tail = RO_DEC(cb_tail);
-                        if (keyboard_report->keys[RO_DEC(cb_tail)] != 0) {
-                            break;
-                        }
-                    } while (cb_tail != cb_head);
-                }
-                break;
-            }
-            i = RO_INC(i);
-        } while (i != cb_tail);
-    }
-#else
     for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
         if (keyboard_report->keys[i] == code) {
             keyboard_report->keys[i] = 0;
+            key_count--;
+#ifdef USB_6KRO_ENABLE
+            ro_unlink(i);
+#endif
+            return;
         }
     }
-#endif
 }
 
 #ifdef NKRO_ENABLE
 static inline void add_key_bit(uint8_t code)
 {
     if ((code>>3) < KEYBOARD_REPORT_BITS) {
+        if (!(keyboard_report->nkro.bits[code>>3] & 1<<(code&7))) key_count++;
         keyboard_report->nkro.bits[code>>3] |= 1<<(code&7);
     } else {
         dprintf("add_key_bit: can't add: %02X\n", code);
@@ -299,6 +267,7 @@ static inline void add_key_bit(uint8_t code)
 static inline void del_key_bit(uint8_t code)
 {
     if ((code>>3) < KEYBOARD_REPORT_BITS) {
+        if (keyboard_report->nkro.bits[code>>3] & 1<<(code&7)) key_count--;
         keyboard_report->nkro.bits[code>>3] &= ~(1<<(code&7));
     } else {
         dprintf("del_key_bit: can't del: %02X\n", code);
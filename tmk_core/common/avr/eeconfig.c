@@ -43,3 +43,13 @@ void eeconfig_write_keymap(uint8_t val) { eeprom_write_byte(EECONFIG_KEYMAP, val
 uint8_t eeconfig_read_backlight(void)      { return eeprom_read_byte(EECONFIG_BACKLIGHT); }
 void eeconfig_write_backlight(uint8_t val) { eeprom_write_byte(EECONFIG_BACKLIGHT, val); }
 #endif
+
+#ifdef ADAPTIVE_TAPPING_ENABLE
+void eeconfig_read_tapping(void *buf, uint8_t len) { eeprom_read_block(buf, EECONFIG_TAPPING, len); }
+bool eeconfig_update_tapping(uint8_t offset, uint8_t val)
+{
+    if (!eeprom_is_ready()) return false;
+    eeprom_update_byte(EECONFIG_TAPPING + offset, val);
+    return true;
+}
+#endif
@@ -49,23 +49,51 @@ static void power_down(uint8_t wdto)
 #ifdef PROTOCOL_LUFA
     if (USB_DeviceState == DEVICE_STATE_Configured) return;
 #endif
+
     wdt_timeout = wdto;
 
     // Watchdog Interrupt Mode
     wdt_intr_enable(wdto);
 
-    // TODO: more power saving
+    // Analog comparator and ADC off, I/O ports are left to matrix_power_down()
     // See PicoPower application note
-    // - I/O port input with pullup
-    // - prescale clock
-    // - BOD disable
-    // - Power Reduction Register PRR
+    uint8_t acsr = ACSR;
+    ACSR = (1<<ACD);
+#ifdef ADCSRA
+    uint8_t adcsra = ADCSRA;
+    ADCSRA &= ~(1<<ADEN);
+#endif
+
+    // Power Reduction Register: clock of unused modules off
+#if defined(PRR0)
+    uint8_t prr0 = PRR0;
+    PRR0 |= (1<<PRADC) | (1<<PRSPI);
+#elif defined(PRR)
+    uint8_t prr = PRR;
+    PRR |= (1<<PRADC) | (1<<PRSPI);
+#endif
+
     set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    cli();
     sleep_enable();
+#ifdef sleep_bod_disable
+    // BOD off while sleeping, not available on ATMega32u4
+    sleep_bod_disable();
+#endif
     sei();
     sleep_cpu();
     sleep_disable();
 
+#if defined(PRR0)
+    PRR0 = prr0;
+#elif defined(PRR)
+    PRR = prr;
+#endif
+#ifdef ADCSRA
+    ADCSRA = adcsra;
+#endif
+    ACSR = acsr;
+
     // Disable watchdog after sleep
     wdt_disable();
 }
@@ -109,6 +137,8 @@ void suspend_power_down(void)
 #endif
 }
 
+/* Keyboard can replace this with quicker check, e.g. all rows selected */
+__attribute__ ((weak))
 bool suspend_wakeup_condition(void)
 {
     matrix_power_up();
@@ -124,6 +154,7 @@ bool suspend_wakeup_condition(void)
 void suspend_wakeup_init(void)
 {
     // clear keyboard state
+    matrix_power_up();
     matrix_clear();
     clear_keyboard();
 #ifdef BACKLIGHT_ENABLE
@@ -1,6 +1,6 @@
 #include <stdint.h>
 #include <stdbool.h>
-#include "wait.h"
+#include "timer.h"
 #include "matrix.h"
 #include "bootloader.h"
 #include "debug.h"
@@ -21,10 +21,17 @@ void bootmagic(void)
         eeconfig_init();
     }
 
-    /* do scans in case of bounce */
+    /* do scans in case of bounce, debounce of matrix needs repeated scans
+     * since matrix got ready */
     print("bootmagic scan: ... ");
-    uint8_t scan = 100;
-    while (scan--) { matrix_scan(); wait_ms(10); }
+    uint16_t start = timer_read();
+    uint16_t ready = start;
+    do {
+        if (timer_elapsed(start) < BOOTMAGIC_READY_TIMEOUT && !hook_bootmagic_matrix_ready()) {
+            ready = timer_read();
+        }
+        matrix_scan();
+    } while (timer_elapsed(ready) < BOOTMAGIC_SCAN_TIME);
     print("done.\n");
 
     /* bootmagic skip */
@@ -2,6 +2,16 @@
 #define BOOTMAGIC_H
 
 
+/* period to scan matrix for settling keys(ms) */
+#ifndef BOOTMAGIC_SCAN_TIME
+#define BOOTMAGIC_SCAN_TIME             20
+#endif
+
+/* period to wait for matrix to get ready, see hook_bootmagic_matrix_ready()(ms) */
+#ifndef BOOTMAGIC_READY_TIMEOUT
+#define BOOTMAGIC_READY_TIMEOUT         100
+#endif
+
 /* bootmagic salt key */
 #ifndef BOOTMAGIC_KEY_SALT
 #define BOOTMAGIC_KEY_SALT              KC_SPACE
@@ -33,6 +33,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "led.h"
 #include "command.h"
 #include "backlight.h"
+#include "action_tapping.h"
 
 #ifdef MOUSEKEY_ENABLE
 #include "mousekey.h"
@@ -49,6 +50,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #   include "usbdrv.h"
 #endif
 
+#ifdef PROTOCOL_LUFA
+#   include "lufa.h"
+#endif
+
+#ifdef PROTOCOL_CHIBIOS
+#   include "usb_main.h"
+#endif
+
 
 static bool command_common(uint8_t code);
 static void command_common_help(void);
@@ -108,6 +117,28 @@ bool command_console_extra(uint8_t code)
     return false;
 }
 
+/* Command sent as character from host console, same as magic key.
+ * Letters, digits, Esc and '?' are accepted. Console and mousekey modes
+ * would take keys typed on keyboard, so host can't enter them. */
+bool command_char(uint8_t c)
+{
+    uint8_t code;
+    if (c >= 'a' && c <= 'z')       code = KC_A + (c - 'a');
+    else if (c >= 'A' && c <= 'Z')  code = KC_A + (c - 'A');
+    else if (c >= '1' && c <= '9')  code = KC_1 + (c - '1');
+    else if (c == '0')              code = KC_0;
+    else if (c == '\033')           code = KC_ESC;
+    else if (c == '?')              code = KC_SLASH;
+    else return false;
+
+    if (code == KC_C) return false;
+    /* command_extra() may change mode too */
+    command_state_t state = command_state;
+    bool done = (command_extra(code) || command_common(code));
+    command_state = state;
+    return done;
+}
+
 
 /***********************************************************
  * Command common
@@ -140,6 +171,10 @@ static void command_common_help(void)
 #ifdef SLEEP_LED_ENABLE
           "z:	sleep LED test\n"
 #endif
+
+#ifdef ADAPTIVE_TAPPING_ENABLE
+          "t:	tapping term\n"
+#endif
     );
 }
 
@@ -206,6 +241,11 @@ static bool command_common(uint8_t code)
             print_eeconfig();
             break;
 #endif
+#if defined(ADAPTIVE_TAPPING_ENABLE) && !defined(NO_ACTION_TAPPING)
+        case KC_T:
+            tapping_term_print();
+            break;
+#endif
 #ifdef KEYBOARD_LOCK_ENABLE
         case KC_CAPSLOCK:
             if (host_get_driver()) {
@@ -316,6 +356,9 @@ static bool command_common(uint8_t code)
 #ifdef NKRO_ENABLE
             " NKRO"
 #endif
+#ifdef ADAPTIVE_TAPPING_ENABLE
+            " ADAPTIVE_TAPPING"
+#endif
 #ifdef KEYMAP_SECTION_ENABLE
             " KEYMAP_SECTION"
 #endif
@@ -339,6 +382,28 @@ static bool command_common(uint8_t code)
             print_val_hex8(keyboard_nkro);
 #endif
             print_val_hex32(timer_read32());
+            print_val_hex16(host_report_sent());
+            print_val_hex16(host_report_suppressed());
+#ifdef PROTOCOL_LUFA
+            print_val_dec(usb_isr_max());
+            print_val_dec(usb_report_latency_max());
+#endif
+#if defined(PROTOCOL_LUFA) && defined(CONSOLE_ENABLE)
+            print_val_hex16(console_dropped());
+#endif
+
+#ifdef PROTOCOL_CHIBIOS
+            print_val_dec(keyboard_thread_stats.scan_time_max);
+            print_val_dec(keyboard_thread_stats.scan_gap_max);
+            print_val_dec(keyboard_thread_stats.event_delay_max);
+            print_val_dec(keyboard_thread_stats.mailbox_max);
+            print_val_dec(keyboard_thread_stats.mailbox_full);
+            print_val_dec(report_stats.queued);
+            print_val_dec(report_stats.coalesced);
+            print_val_dec(report_stats.merged);
+            print_val_dec(report_stats.lost);
+            print_val_dec(report_stats.dropped);
+#endif
 
 #ifdef PROTOCOL_PJRC
             print_val_hex8(UDCON);
@@ -28,8 +28,10 @@ bool command_console_extra(uint8_t code);
 
 #ifdef COMMAND_ENABLE
 bool command_proc(uint8_t code);
+bool command_char(uint8_t c);
 #else
 #define command_proc(code)      false
+#define command_char(c)         false
 #endif
 
 #endif
@@ -31,6 +31,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define EECONFIG_KEYMAP                             (uint8_t *)4
 #define EECONFIG_MOUSEKEY_ACCEL                     (uint8_t *)5
 #define EECONFIG_BACKLIGHT                          (uint8_t *)6
+#define EECONFIG_TAPPING                            (uint8_t *)8
 
 
 /* debug bit */
@@ -72,4 +73,10 @@ uint8_t eeconfig_read_backlight(void);
 void eeconfig_write_backlight(uint8_t val);
 #endif
 
+#ifdef ADAPTIVE_TAPPING_ENABLE
+void eeconfig_read_tapping(void *buf, uint8_t len);
+/* return false when EEPROM is busy */
+bool eeconfig_update_tapping(uint8_t offset, uint8_t val);
+#endif
+
 #endif
@@ -47,3 +47,6 @@ void hook_keyboard_leds_change(uint8_t led_status) {
 
 __attribute__((weak))
 void hook_bootmagic(void) {}
+
+__attribute__((weak))
+bool hook_bootmagic_matrix_ready(void) { return true; }
@@ -66,7 +66,7 @@ void hook_default_layer_change(uint32_t default_layer_state);
 
 /* Called on layer state change event. */
 /* Default behaviour: do nothing. */
-void hook_layer_change(uint32_t layer_state);
+void hook_layer_change(uint32_t state);
 
 /* Called on indicator LED update event (when reported from host). */
 /* Default behaviour: calls keyboard_set_leds. */
@@ -76,5 +76,10 @@ void hook_keyboard_leds_change(uint8_t led_status);
 /* Default behaviour: do nothing. */
 void hook_bootmagic(void);
 
+/* Called repeatedly while bootmagic scans matrix, until it returns true or
+ * BOOTMAGIC_READY_TIMEOUT passes. Keyboard can retry init of its matrix here. */
+/* Default behaviour: returns true. */
+bool hook_bootmagic_matrix_ready(void);
+
 
 #endif /* _HOOKS_H_ */
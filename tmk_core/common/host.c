@@ -16,6 +16,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdint.h>
+#include <string.h>
 //#include <avr/interrupt.h>
 #include "keycode.h"
 #include "host.h"
@@ -27,9 +28,27 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 bool keyboard_nkro = true;
 #endif
 
+uint8_t mouse_resolution = 0;
+
 static host_driver_t *driver;
 static uint16_t last_system_report = 0;
 static uint16_t last_consumer_report = 0;
+static report_keyboard_t last_keyboard_report;
+static uint8_t last_mouse_buttons = 0;
+static uint16_t report_sent = 0;
+static uint16_t report_suppressed = 0;
+/* set from USB interrupt, reports are forgotten in main loop */
+static volatile bool last_reports_stale = false;
+
+static void forget_stale_reports(void)
+{
+    if (!last_reports_stale) return;
+    last_reports_stale = false;
+    memset(&last_keyboard_report, 0, sizeof(report_keyboard_t));
+    last_mouse_buttons = 0;
+    last_system_report = 0;
+    last_consumer_report = 0;
+}
 
 
 void host_set_driver(host_driver_t *d)
@@ -51,6 +70,13 @@ uint8_t host_keyboard_leds(void)
 void host_keyboard_send(report_keyboard_t *report)
 {
     if (!driver) return;
+    forget_stale_reports();
+    if (memcmp(report, &last_keyboard_report, sizeof(report_keyboard_t)) == 0) {
+        report_suppressed++;
+        return;
+    }
+    last_keyboard_report = *report;
+    report_sent++;
     (*driver->send_keyboard)(report);
 
     if (debug_keyboard) {
@@ -65,15 +91,29 @@ void host_keyboard_send(report_keyboard_t *report)
 void host_mouse_send(report_mouse_t *report)
 {
     if (!driver) return;
+    forget_stale_reports();
+    // movement is relative, only report without it can be a duplicate
+    if (report->buttons == last_mouse_buttons &&
+            !report->x && !report->y && !report->v && !report->h) {
+        report_suppressed++;
+        return;
+    }
+    last_mouse_buttons = report->buttons;
+    report_sent++;
     (*driver->send_mouse)(report);
 }
 
 void host_system_send(uint16_t report)
 {
-    if (report == last_system_report) return;
+    forget_stale_reports();
+    if (report == last_system_report) {
+        report_suppressed++;
+        return;
+    }
     last_system_report = report;
 
     if (!driver) return;
+    report_sent++;
     (*driver->send_system)(report);
 
     if (debug_keyboard) {
@@ -83,10 +123,15 @@ void host_system_send(uint16_t report)
 
 void host_consumer_send(uint16_t report)
 {
-    if (report == last_consumer_report) return;
+    forget_stale_reports();
+    if (report == last_consumer_report) {
+        report_suppressed++;
+        return;
+    }
     last_consumer_report = report;
 
     if (!driver) return;
+    report_sent++;
     (*driver->send_consumer)(report);
 
     if (debug_keyboard) {
@@ -94,12 +139,29 @@ void host_consumer_send(uint16_t report)
     }
 }
 
+void host_clear_last_reports(void)
+{
+    last_reports_stale = true;
+}
+
 uint16_t host_last_system_report(void)
 {
+    forget_stale_reports();
     return last_system_report;
 }
 
 uint16_t host_last_consumer_report(void)
 {
+    forget_stale_reports();
     return last_consumer_report;
 }
+
+uint16_t host_report_sent(void)
+{
+    return report_sent;
+}
+
+uint16_t host_report_suppressed(void)
+{
+    return report_suppressed;
+}
@@ -35,6 +35,9 @@ extern bool keyboard_nkro;
 extern uint8_t keyboard_idle;
 extern uint8_t keyboard_protocol;
 
+/* Resolution Multiplier feature report set by host(MOUSE_RESOLUTION_*) */
+extern uint8_t mouse_resolution;
+
 
 /* host driver */
 void host_set_driver(host_driver_t *driver);
@@ -47,9 +50,17 @@ void host_mouse_send(report_mouse_t *report);
 void host_system_send(uint16_t data);
 void host_consumer_send(uint16_t data);
 
+/* host lost reports sent so far(USB reset or reconfiguration), next
+ * reports are not suppressed as duplicates of them. Safe from interrupt. */
+void host_clear_last_reports(void);
+
 uint16_t host_last_system_report(void);
 uint16_t host_last_consumer_report(void);
 
+/* number of reports sent and suppressed as identical to the last one */
+uint16_t host_report_sent(void);
+uint16_t host_report_suppressed(void);
+
 #ifdef __cplusplus
 }
 #endif
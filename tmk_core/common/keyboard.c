@@ -31,6 +31,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "eeconfig.h"
 #include "backlight.h"
 #include "hook.h"
+#include "action_macro.h"
+#include "action_combo.h"
 #ifdef MOUSEKEY_ENABLE
 #   include "mousekey.h"
 #endif
@@ -63,6 +65,37 @@ static bool has_ghost_in_row(uint8_t row)
 #endif
 
 
+#ifdef RAW_ENABLE
+/* scan statistics, updated every second */
+static uint16_t scan_count = 0;
+static uint16_t scan_rate = 0;
+static uint16_t scan_gap = 0;
+static uint16_t scan_gap_max = 0;
+static uint16_t scan_last = 0;
+static uint16_t scan_start = 0;
+
+static void scan_stats(void)
+{
+    uint16_t now = timer_read();
+    uint16_t gap = TIMER_DIFF_16(now, scan_last);
+    scan_last = now;
+
+    if (gap > scan_gap) scan_gap = gap;
+    scan_count++;
+    if (TIMER_DIFF_16(now, scan_start) >= 1000) {
+        scan_rate = scan_count;
+        scan_gap_max = scan_gap;
+        scan_count = 0;
+        scan_gap = 0;
+        scan_start = now;
+    }
+}
+
+uint16_t keyboard_scan_rate(void) { return scan_rate; }
+uint16_t keyboard_scan_gap(void) { return scan_gap_max; }
+#endif
+
+
 void keyboard_setup(void)
 {
     matrix_setup();
@@ -90,23 +123,37 @@ void keyboard_init(void)
 #ifdef BACKLIGHT_ENABLE
     backlight_init();
 #endif
+
+    action_combo_init();
+
+#ifdef RAW_ENABLE
+    scan_start = scan_last = timer_read();
+#endif
 }
 
-/*
- * Do keyboard routine jobs: scan mantrix, light LEDs, ...
- * This is repeatedly called as fast as possible.
- */
-void keyboard_task(void)
+/* scan matrix, key changes are taken by keyboard_event() */
+void keyboard_scan(void)
 {
-    static matrix_row_t matrix_prev[MATRIX_ROWS];
+#ifdef RAW_ENABLE
+    scan_stats();
+#endif
+
+    matrix_scan();
+}
+
+static matrix_row_t matrix_prev[MATRIX_ROWS];
+/* matrix is printed by keyboard_routine(), keyboard_event() may run in scan thread */
+static volatile bool matrix_print_pending = false;
 #ifdef MATRIX_HAS_GHOST
-    static matrix_row_t matrix_ghost[MATRIX_ROWS];
+static matrix_row_t matrix_ghost[MATRIX_ROWS];
 #endif
-    static uint8_t led_status = 0;
+
+/* find a key change in scanned matrix, it is recorded as processed */
+bool keyboard_event(keyevent_t *event)
+{
     matrix_row_t matrix_row = 0;
     matrix_row_t matrix_change = 0;
 
-    matrix_scan();
     for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
         matrix_row = matrix_get_row(r);
         matrix_change = matrix_row ^ matrix_prev[r];
@@ -118,35 +165,46 @@ void keyboard_task(void)
                  * the last key would be lost.
                  */
                 if (debug_matrix && matrix_ghost[r] != matrix_row) {
-                    matrix_print();
+                    matrix_print_pending = true;
                 }
                 matrix_ghost[r] = matrix_row;
                 continue;
             }
             matrix_ghost[r] = matrix_row;
 #endif
-            if (debug_matrix) matrix_print();
+            if (debug_matrix) matrix_print_pending = true;
             for (uint8_t c = 0; c < MATRIX_COLS; c++) {
                 if (matrix_change & ((matrix_row_t)1<<c)) {
-                    keyevent_t e = (keyevent_t){
+                    *event = (keyevent_t){
                         .key = (keypos_t){ .row = r, .col = c },
                         .pressed = (matrix_row & ((matrix_row_t)1<<c)),
                         .time = (timer_read() | 1) /* time should not be 0 */
                     };
-                    action_exec(e);
-                    hook_matrix_change(e);
                     // record a processed key
                     matrix_prev[r] ^= ((matrix_row_t)1<<c);
-                    // process a key per task call
-                    goto MATRIX_LOOP_END;
+                    return true;
                 }
             }
         }
     }
-    // call with pseudo tick event when no real key event.
-    action_exec(TICK);
+    return false;
+}
+
+/* jobs done after each key event or tick */
+void keyboard_routine(void)
+{
+    static uint8_t led_status = 0;
+
+    if (matrix_print_pending) {
+        matrix_print_pending = false;
+        matrix_print();
+    }
+
+    // macro playback
+    action_macro_task();
 
-MATRIX_LOOP_END:
+    // locking key release
+    action_locking_task();
 
     hook_keyboard_loop();
 
@@ -175,6 +233,28 @@ MATRIX_LOOP_END:
     }
 }
 
+/*
+ * Do keyboard routine jobs: scan mantrix, light LEDs, ...
+ * This is repeatedly called as fast as possible.
+ */
+void keyboard_task(void)
+{
+    keyevent_t e;
+
+    keyboard_scan();
+
+    // process a key per task call
+    if (keyboard_event(&e)) {
+        action_exec(e);
+        hook_matrix_change(e);
+    } else {
+        // call with pseudo tick event when no real key event.
+        action_exec(TICK);
+    }
+
+    keyboard_routine();
+}
+
 void keyboard_set_leds(uint8_t leds)
 {
     led_set(leds);
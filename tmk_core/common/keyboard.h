@@ -64,9 +64,19 @@ void keyboard_setup(void);
 void keyboard_init(void);
 /* it runs repeatedly in main loop */
 void keyboard_task(void);
+/* parts of keyboard_task() for protocols which scan in separate thread */
+void keyboard_scan(void);
+bool keyboard_event(keyevent_t *event);
+void keyboard_routine(void);
 /* it runs when host LED status is updated */
 void keyboard_set_leds(uint8_t leds);
 
+#ifdef RAW_ENABLE
+/* matrix scans and longest interval between scans(ms) in last second */
+uint16_t keyboard_scan_rate(void);
+uint16_t keyboard_scan_gap(void);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -38,6 +38,12 @@ void matrix_clear(void)
 __attribute__ ((weak))
 void matrix_setup(void) {}
 
+__attribute__ ((weak))
+uint16_t matrix_errors(void)
+{
+    return 0;
+}
+
 __attribute__ ((weak))
 bool matrix_is_on(uint8_t row, uint8_t col)
 {
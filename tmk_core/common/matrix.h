@@ -63,6 +63,8 @@ matrix_row_t matrix_get_row(uint8_t row);
 void matrix_print(void);
 /* clear matrix */
 void matrix_clear(void);
+/* number of errors in reading matrix, e.g. I2C(optional) */
+uint16_t matrix_errors(void);
 
 #ifdef MATRIX_HAS_GHOST
 bool matrix_has_ghost_in_row(uint8_t row);
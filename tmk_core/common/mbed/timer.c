@@ -1,5 +1,7 @@
 #include "cmsis.h"
+#include "us_ticker_api.h"
 #include "timer.h"
+#include "timer_mbed.h"
 
 /* Mill second tick count */
 volatile uint32_t timer_count = 0;
@@ -13,6 +15,7 @@ void timer_init(void)
 {
     timer_count = 0;
     SysTick_Config(SystemCoreClock / 1000); /* 1ms tick */
+    us_ticker_init();
 }
 
 void timer_clear(void)
@@ -39,3 +42,8 @@ uint32_t timer_elapsed32(uint32_t last)
 {
     return TIMER_DIFF_32(timer_read32(), last);
 }
+
+uint32_t timer_read_us(void)
+{
+    return us_ticker_read();
+}
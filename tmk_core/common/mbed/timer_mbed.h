@@ -0,0 +1,19 @@
+#ifndef TIMER_MBED_H
+#define TIMER_MBED_H 1
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Micro second timestamp from us_ticker, wraps around in about 71 minutes.
+ * Unlike timer_read() this doesn't depend on SysTick interrupt and is
+ * usable in USB interrupt handler. */
+uint32_t timer_read_us(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
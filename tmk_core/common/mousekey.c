@@ -26,9 +26,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
 static report_mouse_t mouse_report = {};
-static uint8_t mousekey_repeat =  0;
 static uint8_t mousekey_accel = 0;
 
+/* direction of cursor and wheel keys held: -1, 0 or 1 */
+static int8_t dir_x = 0, dir_y = 0, dir_v = 0, dir_h = 0;
+/* part of unit not sent yet(1/256) */
+static uint8_t frac_x, frac_y, frac_v, frac_h;
+/* time since cursor or wheel key was pressed(ms) */
+static uint16_t move_time = 0;
+
 static void mousekey_debug(void);
 
 
@@ -37,14 +43,17 @@ static void mousekey_debug(void);
  *  http://en.wikipedia.org/wiki/Mouse_keys
  *
  *  speed = delta * max_speed * (repeat / time_to_max)**((1000+curve)/1000)
+ *
+ * Speed is in 1/256 unit per interval and ramps up in time, not per event,
+ * so that motion is accumulated in fixed point and sent every report.
  */
 /* milliseconds between the initial key press and first repeated motion event (0-2550) */
 uint8_t mk_delay = MOUSEKEY_DELAY/10;
-/* milliseconds between repeated motion events (0-255) */
+/* milliseconds in which max_speed units are moved (0-255) */
 uint8_t mk_interval = MOUSEKEY_INTERVAL;
-/* steady speed (in action_delta units) applied each event (0-255) */
+/* steady speed (in action_delta units) applied each interval (0-255) */
 uint8_t mk_max_speed = MOUSEKEY_MAX_SPEED;
-/* number of events (count) accelerating to steady speed (0-255) */
+/* number of intervals accelerating to steady speed (0-255) */
 uint8_t mk_time_to_max = MOUSEKEY_TIME_TO_MAX;
 /* ramp used to reach maximum pointer speed (NOT SUPPORTED) */
 //int8_t mk_curve = 0;
@@ -56,85 +65,122 @@ uint8_t mk_wheel_time_to_max = MOUSEKEY_WHEEL_TIME_TO_MAX;
 static uint16_t last_timer = 0;
 
 
-static uint8_t move_unit(void)
+/* speed in 1/256 unit per interval */
+static uint16_t unit_speed(uint8_t delta, uint8_t max_speed, uint8_t time_to_max, uint8_t limit)
 {
-    uint16_t unit;
+    uint8_t interval = mk_interval ? mk_interval : 1;
+    uint16_t delay = mk_delay * 10;
+    uint32_t full = (uint32_t)delta * max_speed;
+    uint32_t unit;
+
     if (mousekey_accel & (1<<0)) {
-        unit = (MOUSEKEY_MOVE_DELTA * mk_max_speed)/4;
+        unit = (full << 8) / 4;
     } else if (mousekey_accel & (1<<1)) {
-        unit = (MOUSEKEY_MOVE_DELTA * mk_max_speed)/2;
+        unit = (full << 8) / 2;
     } else if (mousekey_accel & (1<<2)) {
-        unit = (MOUSEKEY_MOVE_DELTA * mk_max_speed);
-    } else if (mousekey_repeat == 0) {
-        unit = MOUSEKEY_MOVE_DELTA;
-    } else if (mousekey_repeat >= mk_time_to_max) {
-        unit = MOUSEKEY_MOVE_DELTA * mk_max_speed;
+        unit = full << 8;
+    } else if (move_time < delay) {
+        unit = (uint32_t)delta << 8;
     } else {
-        unit = (MOUSEKEY_MOVE_DELTA * mk_max_speed * mousekey_repeat) / mk_time_to_max;
+        // linear ramp, reaches full speed after time_to_max intervals
+        uint16_t ramp = time_to_max * interval;
+        uint16_t t = move_time - delay + interval;
+        if (t < ramp) {
+            uint32_t n = full * t;
+            unit = (n < (1UL<<24) ? (n << 8) / ramp : n / ramp << 8);
+        } else {
+            unit = full << 8;
+        }
     }
-    return (unit > MOUSEKEY_MOVE_MAX ? MOUSEKEY_MOVE_MAX : (unit == 0 ? 1 : unit));
+    if (unit > (uint16_t)limit << 8) return (uint16_t)limit << 8;
+    if (unit < 1<<8) return 1<<8;
+    return unit;
 }
 
-static uint8_t wheel_unit(void)
+static uint16_t move_speed(void)
 {
-    uint16_t unit;
-    if (mousekey_accel & (1<<0)) {
-        unit = (MOUSEKEY_WHEEL_DELTA * mk_wheel_max_speed)/4;
-    } else if (mousekey_accel & (1<<1)) {
-        unit = (MOUSEKEY_WHEEL_DELTA * mk_wheel_max_speed)/2;
-    } else if (mousekey_accel & (1<<2)) {
-        unit = (MOUSEKEY_WHEEL_DELTA * mk_wheel_max_speed);
-    } else if (mousekey_repeat == 0) {
-        unit = MOUSEKEY_WHEEL_DELTA;
-    } else if (mousekey_repeat >= mk_wheel_time_to_max) {
-        unit = MOUSEKEY_WHEEL_DELTA * mk_wheel_max_speed;
-    } else {
-        unit = (MOUSEKEY_WHEEL_DELTA * mk_wheel_max_speed * mousekey_repeat) / mk_wheel_time_to_max;
-    }
-    return (unit > MOUSEKEY_WHEEL_MAX ? MOUSEKEY_WHEEL_MAX : (unit == 0 ? 1 : unit));
+    return unit_speed(MOUSEKEY_MOVE_DELTA, mk_max_speed, mk_time_to_max, MOUSEKEY_MOVE_MAX);
 }
 
-void mousekey_task(void)
+static uint16_t wheel_speed(void)
 {
-    if (timer_elapsed(last_timer) < (mousekey_repeat ? mk_interval : mk_delay*10))
-        return;
+    return unit_speed(MOUSEKEY_WHEEL_DELTA, mk_wheel_max_speed, mk_wheel_time_to_max, MOUSEKEY_WHEEL_MAX);
+}
 
-    if (mouse_report.x == 0 && mouse_report.y == 0 && mouse_report.v == 0 && mouse_report.h == 0)
-        return;
+/* add step to part not sent yet and return whole units */
+static int8_t unit_step(uint8_t *frac, uint32_t step, int8_t dir, uint8_t limit)
+{
+    if (!dir) return 0;
+    step += *frac;
+    *frac = step & 0xFF;
+    step >>= 8;
+    if (step > limit) step = limit;
+    return (dir < 0 ? -(int8_t)step : (int8_t)step);
+}
 
-    if (mousekey_repeat != UINT8_MAX)
-        mousekey_repeat++;
+/* fine wheel steps when host enabled Resolution Multiplier */
+static int8_t wheel_step(uint8_t *frac, uint32_t step, int8_t dir, uint8_t resolution)
+{
+    if (mouse_resolution & resolution) step *= MOUSE_WHEEL_RESOLUTION;
+    return unit_step(frac, step, dir, MOUSEKEY_WHEEL_MAX);
+}
 
+void mousekey_task(void)
+{
+    if (!dir_x && !dir_y && !dir_v && !dir_h)
+        return;
 
-    if (mouse_report.x > 0) mouse_report.x = move_unit();
-    if (mouse_report.x < 0) mouse_report.x = move_unit() * -1;
-    if (mouse_report.y > 0) mouse_report.y = move_unit();
-    if (mouse_report.y < 0) mouse_report.y = move_unit() * -1;
+    uint16_t elapsed = timer_elapsed(last_timer);
+    if (elapsed < MOUSEKEY_REPORT_INTERVAL)
+        return;
+    last_timer = timer_read();
 
-    /* diagonal move [1/sqrt(2) = 0.7] */
-    if (mouse_report.x && mouse_report.y) {
-        mouse_report.x *= 0.7;
-        mouse_report.y *= 0.7;
+    // count only time after delay
+    uint16_t delay = mk_delay * 10;
+    uint16_t before = move_time;
+    move_time = (UINT16_MAX - move_time < elapsed ? UINT16_MAX : move_time + elapsed);
+    if (move_time < delay)
+        return;
+    if (before < delay)
+        elapsed = move_time - delay;
+    if (elapsed > UINT8_MAX)
+        elapsed = UINT8_MAX;
+
+    uint8_t interval = mk_interval ? mk_interval : 1;
+    uint32_t move = (uint32_t)move_speed() * elapsed / interval;
+    uint32_t wheel = (uint32_t)wheel_speed() * elapsed / interval;
+
+    /* diagonal move [1/sqrt(2) = 181/256] */
+    if (dir_x && dir_y) {
+        move = move * 181 >> 8;
     }
 
-    if (mouse_report.v > 0) mouse_report.v = wheel_unit();
-    if (mouse_report.v < 0) mouse_report.v = wheel_unit() * -1;
-    if (mouse_report.h > 0) mouse_report.h = wheel_unit();
-    if (mouse_report.h < 0) mouse_report.h = wheel_unit() * -1;
+    mouse_report.x = unit_step(&frac_x, move, dir_x, MOUSEKEY_MOVE_MAX);
+    mouse_report.y = unit_step(&frac_y, move, dir_y, MOUSEKEY_MOVE_MAX);
+    mouse_report.v = wheel_step(&frac_v, wheel, dir_v, MOUSE_RESOLUTION_WHEEL);
+    mouse_report.h = wheel_step(&frac_h, wheel, dir_h, MOUSE_RESOLUTION_PAN);
 
-    mousekey_send();
+    if (mouse_report.x || mouse_report.y || mouse_report.v || mouse_report.h)
+        mousekey_send();
 }
 
 void mousekey_on(uint8_t code)
 {
-    if      (code == KC_MS_UP)       mouse_report.y = move_unit() * -1;
-    else if (code == KC_MS_DOWN)     mouse_report.y = move_unit();
-    else if (code == KC_MS_LEFT)     mouse_report.x = move_unit() * -1;
-    else if (code == KC_MS_RIGHT)    mouse_report.x = move_unit();
-    else if (code == KC_MS_WH_UP)    mouse_report.v = wheel_unit();
-    else if (code == KC_MS_WH_DOWN)  mouse_report.v = wheel_unit() * -1;
-    else if (code == KC_MS_WH_LEFT)  mouse_report.h = wheel_unit() * -1;
-    else if (code == KC_MS_WH_RIGHT) mouse_report.h = wheel_unit();
+    if (!dir_x && !dir_y && !dir_v && !dir_h) {
+        move_time = 0;
+        frac_x = frac_y = frac_v = frac_h = 0;
+        last_timer = timer_read();
+    }
+
+    // first step is sent at once
+    if      (code == KC_MS_UP)       { dir_y = -1; mouse_report.y = (move_speed()>>8) * -1; }
+    else if (code == KC_MS_DOWN)     { dir_y =  1; mouse_report.y = move_speed()>>8; }
+    else if (code == KC_MS_LEFT)     { dir_x = -1; mouse_report.x = (move_speed()>>8) * -1; }
+    else if (code == KC_MS_RIGHT)    { dir_x =  1; mouse_report.x = move_speed()>>8; }
+    else if (code == KC_MS_WH_UP)    { dir_v =  1; mouse_report.v = wheel_step(&frac_v, wheel_speed(), dir_v, MOUSE_RESOLUTION_WHEEL); }
+    else if (code == KC_MS_WH_DOWN)  { dir_v = -1; mouse_report.v = wheel_step(&frac_v, wheel_speed(), dir_v, MOUSE_RESOLUTION_WHEEL); }
+    else if (code == KC_MS_WH_LEFT)  { dir_h = -1; mouse_report.h = wheel_step(&frac_h, wheel_speed(), dir_h, MOUSE_RESOLUTION_PAN); }
+    else if (code == KC_MS_WH_RIGHT) { dir_h =  1; mouse_report.h = wheel_step(&frac_h, wheel_speed(), dir_h, MOUSE_RESOLUTION_PAN); }
     else if (code == KC_MS_BTN1)     mouse_report.buttons |= MOUSE_BTN1;
     else if (code == KC_MS_BTN2)     mouse_report.buttons |= MOUSE_BTN2;
     else if (code == KC_MS_BTN3)     mouse_report.buttons |= MOUSE_BTN3;
@@ -147,14 +193,14 @@ void mousekey_on(uint8_t code)
 
 void mousekey_off(uint8_t code)
 {
-    if      (code == KC_MS_UP       && mouse_report.y < 0) mouse_report.y = 0;
-    else if (code == KC_MS_DOWN     && mouse_report.y > 0) mouse_report.y = 0;
-    else if (code == KC_MS_LEFT     && mouse_report.x < 0) mouse_report.x = 0;
-    else if (code == KC_MS_RIGHT    && mouse_report.x > 0) mouse_report.x = 0;
-    else if (code == KC_MS_WH_UP    && mouse_report.v > 0) mouse_report.v = 0;
-    else if (code == KC_MS_WH_DOWN  && mouse_report.v < 0) mouse_report.v = 0;
-    else if (code == KC_MS_WH_LEFT  && mouse_report.h < 0) mouse_report.h = 0;
-    else if (code == KC_MS_WH_RIGHT && mouse_report.h > 0) mouse_report.h = 0;
+    if      (code == KC_MS_UP       && dir_y < 0) dir_y = 0;
+    else if (code == KC_MS_DOWN     && dir_y > 0) dir_y = 0;
+    else if (code == KC_MS_LEFT     && dir_x < 0) dir_x = 0;
+    else if (code == KC_MS_RIGHT    && dir_x > 0) dir_x = 0;
+    else if (code == KC_MS_WH_UP    && dir_v > 0) dir_v = 0;
+    else if (code == KC_MS_WH_DOWN  && dir_v < 0) dir_v = 0;
+    else if (code == KC_MS_WH_LEFT  && dir_h < 0) dir_h = 0;
+    else if (code == KC_MS_WH_RIGHT && dir_h > 0) dir_h = 0;
     else if (code == KC_MS_BTN1) mouse_report.buttons &= ~MOUSE_BTN1;
     else if (code == KC_MS_BTN2) mouse_report.buttons &= ~MOUSE_BTN2;
     else if (code == KC_MS_BTN3) mouse_report.buttons &= ~MOUSE_BTN3;
@@ -163,34 +209,32 @@ void mousekey_off(uint8_t code)
     else if (code == KC_MS_ACCEL0) mousekey_accel &= ~(1<<0);
     else if (code == KC_MS_ACCEL1) mousekey_accel &= ~(1<<1);
     else if (code == KC_MS_ACCEL2) mousekey_accel &= ~(1<<2);
-
-    if (mouse_report.x == 0 && mouse_report.y == 0 && mouse_report.v == 0 && mouse_report.h == 0)
-        mousekey_repeat = 0;
 }
 
 void mousekey_send(void)
 {
     mousekey_debug();
     host_mouse_send(&mouse_report);
-    last_timer = timer_read();
+    // motion is relative, sent only once
+    mouse_report.x = mouse_report.y = mouse_report.v = mouse_report.h = 0;
 }
 
 void mousekey_clear(void)
 {
     mouse_report = (report_mouse_t){};
-    mousekey_repeat = 0;
+    dir_x = dir_y = dir_v = dir_h = 0;
     mousekey_accel = 0;
 }
 
 static void mousekey_debug(void)
 {
     if (!debug_mouse) return;
-    print("mousekey [btn|x y v h](rep/acl): [");
+    print("mousekey [btn|x y v h](ms/acl): [");
     phex(mouse_report.buttons); print("|");
     print_decs(mouse_report.x); print(" ");
     print_decs(mouse_report.y); print(" ");
     print_decs(mouse_report.v); print(" ");
     print_decs(mouse_report.h); print("](");
-    print_dec(mousekey_repeat); print("/");
+    print_dec(move_time); print("/");
     print_dec(mousekey_accel); print(")\n");
 }
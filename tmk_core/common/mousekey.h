@@ -50,6 +50,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef MOUSEKEY_WHEEL_TIME_TO_MAX
 #define MOUSEKEY_WHEEL_TIME_TO_MAX 40
 #endif
+/* period of reports while moving(ms) */
+#ifndef MOUSEKEY_REPORT_INTERVAL
+#define MOUSEKEY_REPORT_INTERVAL MOUSE_POLLING_INTERVAL
+#endif
 
 
 #ifdef __cplusplus
@@ -0,0 +1,173 @@
+/*
+Copyright 2026 Alexander Neumann <alexander@bumpern.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "raw_hid.h"
+#include "host.h"
+#include "keyboard.h"
+#include "matrix.h"
+#include "action_layer.h"
+#include "action_util.h"
+#include "debug.h"
+#include "timer.h"
+#include "util.h"
+#ifdef PROTOCOL_LUFA
+#   include "lufa.h"
+#endif
+
+
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+    *p++ = v;
+    *p++ = v>>8;
+    return p;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    p = put16(p, v);
+    return put16(p, v>>16);
+}
+
+static uint8_t get_setting(uint8_t id, uint8_t *value)
+{
+    switch (id) {
+        case RAW_HID_SETTING_DEBUG:
+            *value = debug_config.raw;
+            break;
+        case RAW_HID_SETTING_DEFAULT_LAYER:
+            *value = biton32(default_layer_state);
+            break;
+#ifdef NKRO_ENABLE
+        case RAW_HID_SETTING_NKRO:
+            *value = keyboard_nkro;
+            break;
+#endif
+        default:
+            return RAW_HID_INVALID;
+    }
+    return RAW_HID_OK;
+}
+
+static uint8_t set_setting(uint8_t id, uint8_t value)
+{
+    switch (id) {
+        case RAW_HID_SETTING_DEBUG:
+            debug_config.raw = value;
+            break;
+        case RAW_HID_SETTING_DEFAULT_LAYER:
+            if (value >= 32) return RAW_HID_INVALID;
+            default_layer_set(1UL<<value);
+            clear_keyboard();
+            break;
+#ifdef NKRO_ENABLE
+        case RAW_HID_SETTING_NKRO:
+            clear_keyboard(); //Prevents stuck keys.
+            keyboard_nkro = value;
+            break;
+#endif
+        default:
+            return RAW_HID_INVALID;
+    }
+    return RAW_HID_OK;
+}
+
+void raw_hid_receive(uint8_t *data, uint8_t length)
+{
+    uint8_t *end = data + length;
+    uint8_t *p = &data[2];
+    uint8_t arg0 = data[1];
+    uint8_t arg1 = data[2];
+    uint8_t status = RAW_HID_OK;
+
+    if (length < RAW_HID_REPORT_SIZE) return;
+
+    switch (data[0]) {
+        case RAW_HID_VERSION:
+            *p++ = RAW_HID_PROTOCOL_VERSION;
+            *p++ = MATRIX_ROWS;
+            *p++ = MATRIX_COLS;
+            p = put16(p, VENDOR_ID);
+            p = put16(p, PRODUCT_ID);
+            p = put16(p, DEVICE_VER);
+            break;
+        case RAW_HID_COUNTERS:
+            p = put32(p, timer_read32());
+            p = put16(p, keyboard_scan_rate());
+            p = put16(p, keyboard_scan_gap());
+            p = put16(p, host_report_sent());
+            p = put16(p, host_report_suppressed());
+            p = put16(p, matrix_errors());
+#ifdef PROTOCOL_LUFA
+            p = put16(p, usb_isr_max());
+            p = put16(p, usb_report_latency_max());
+#endif
+            break;
+        case RAW_HID_LAYER:
+            p = put32(p, layer_state);
+            p = put32(p, default_layer_state);
+            break;
+        case RAW_HID_MATRIX: {
+            /* rows from arg0 as many as fit in a report */
+            uint8_t row = arg0;
+            if (row >= MATRIX_ROWS) {
+                status = RAW_HID_INVALID;
+                break;
+            }
+            *p++ = row;
+            uint8_t *count = p++;
+            *count = 0;
+            for (; row < MATRIX_ROWS && p + sizeof(matrix_row_t) <= end; row++) {
+                matrix_row_t r = matrix_get_row(row);
+                for (uint8_t i = 0; i < sizeof(matrix_row_t); i++, r >>= 8) {
+                    *p++ = r;
+                }
+                (*count)++;
+            }
+            break;
+        }
+        case RAW_HID_SET_SETTING:
+            status = set_setting(arg0, arg1);
+            if (status) break;
+            /* FALLTHROUGH */
+        case RAW_HID_GET_SETTING:
+            status = get_setting(arg0, &p[1]);
+            if (status) break;
+            *p = arg0;
+            p += 2;
+            break;
+        default:
+            if (data[0] >= RAW_HID_KEYBOARD) {
+                data[1] = raw_hid_receive_kb(data, length);
+            } else {
+                data[1] = RAW_HID_UNKNOWN;
+                memset(p, 0, end - p);
+            }
+            return;
+    }
+    data[1] = status;
+    if (status) p = &data[2];
+    memset(p, 0, end - p);
+}
+
+__attribute__ ((weak))
+uint8_t raw_hid_receive_kb(uint8_t *data, uint8_t length)
+{
+    memset(&data[2], 0, length - 2);
+    return RAW_HID_UNKNOWN;
+}
@@ -0,0 +1,70 @@
+/*
+Copyright 2026 Alexander Neumann <alexander@bumpern.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef RAW_HID_H
+#define RAW_HID_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* Raw HID protocol
+ *
+ * Host writes a request in one report and device answers with one report,
+ * both RAW_HID_REPORT_SIZE bytes padded with zero. Values are little endian.
+ *
+ *   request:   [command] [arguments...]
+ *   response:  [command] [status] [payload...]
+ */
+#define RAW_HID_REPORT_SIZE     32
+#define RAW_HID_PROTOCOL_VERSION    1
+
+/* command */
+enum raw_hid_command {
+    RAW_HID_VERSION = 0x01,     /* -> version, rows, cols, vendor id(16), product id(16), device ver(16) */
+    RAW_HID_COUNTERS,           /* -> timer(32), scan rate(16), scan gap max(16),
+                                      reports sent(16), reports suppressed(16), matrix errors(16),
+                                      usb isr max(16, us), report latency max(16, ms) */
+    RAW_HID_LAYER,              /* -> layer state(32), default layer state(32) */
+    RAW_HID_MATRIX,             /* row -> row, count, rows(matrix_row_t)... */
+    RAW_HID_GET_SETTING,        /* id -> id, value */
+    RAW_HID_SET_SETTING,        /* id, value -> id, value */
+    RAW_HID_KEYBOARD = 0x80,    /* 0x80-0xFF: keyboard specific, see raw_hid_receive_kb() */
+};
+
+/* status */
+enum raw_hid_status {
+    RAW_HID_OK = 0,
+    RAW_HID_UNKNOWN,            /* unknown command */
+    RAW_HID_INVALID,            /* invalid argument */
+};
+
+/* setting id */
+enum raw_hid_setting {
+    RAW_HID_SETTING_DEBUG = 0,  /* debug_config */
+    RAW_HID_SETTING_DEFAULT_LAYER,
+    RAW_HID_SETTING_NKRO,
+};
+
+
+/* process request in data and replace it with response */
+void raw_hid_receive(uint8_t *data, uint8_t length);
+
+/* This allows to define keyboard specific commands. Response payload is
+ * written from data[2], returns status. */
+uint8_t raw_hid_receive_kb(uint8_t *data, uint8_t length);
+
+#endif
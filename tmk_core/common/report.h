@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define REPORT_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "keycode.h"
 
 
@@ -34,6 +35,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MOUSE_BTN4 (1<<3)
 #define MOUSE_BTN5 (1<<4)
 
+/* Resolution Multiplier feature of mouse, enabled by host */
+#define MOUSE_RESOLUTION_WHEEL  (1<<0)
+#define MOUSE_RESOLUTION_PAN    (1<<2)
+
+/* wheel steps per detent with Resolution Multiplier enabled */
+#ifndef MOUSE_WHEEL_RESOLUTION
+#define MOUSE_WHEEL_RESOLUTION  8
+#endif
+
+/* polling interval of mouse endpoint(ms) */
+#ifndef MOUSE_POLLING_INTERVAL
+#define MOUSE_POLLING_INTERVAL  10
+#endif
+
 /* Consumer Page(0x0C)
  * following are supported by Windows: http://msdn.microsoft.com/en-us/windows/hardware/gg463372.aspx
  */
@@ -151,6 +166,93 @@ typedef struct {
 } __attribute__ ((packed)) report_mouse_t;
 
 
+/* Reports waiting for endpoint
+ *
+ * A waiting report may be replaced by a newer one only when the newer still
+ * has every key and button of it(covers), otherwise host would never see a
+ * press. In that case drivers add the keys of the newer report to the
+ * waiting one(merge) and send the newer after it, so that a quick tap shows
+ * up as press then release. size is bytes sent and bitmap tells NKRO report.
+ */
+static inline bool report_keyboard_has_key(const report_keyboard_t *report, uint8_t code, uint8_t size)
+{
+    for (uint8_t i = 2; i < size; i++) {
+        if (report->raw[i] == code) return true;
+    }
+    return false;
+}
+
+static inline bool report_keyboard_covers(const report_keyboard_t *waiting, const report_keyboard_t *next,
+                                          uint8_t size, bool bitmap)
+{
+    if (bitmap) {
+        for (uint8_t i = 0; i < size; i++) {
+            if (waiting->raw[i] & ~next->raw[i]) return false;
+        }
+        return true;
+    }
+    if (waiting->raw[0] & ~next->raw[0]) return false;
+    for (uint8_t i = 2; i < size; i++) {
+        if (waiting->raw[i] && !report_keyboard_has_key(next, waiting->raw[i], size)) return false;
+    }
+    return true;
+}
+
+/* returns false when some keys don't fit in 6KRO report */
+static inline bool report_keyboard_merge(report_keyboard_t *waiting, const report_keyboard_t *next,
+                                         uint8_t size, bool bitmap)
+{
+    if (bitmap) {
+        for (uint8_t i = 0; i < size; i++) {
+            waiting->raw[i] |= next->raw[i];
+        }
+        return true;
+    }
+    waiting->raw[0] |= next->raw[0];
+    bool fit = true;
+    for (uint8_t i = 2; i < size; i++) {
+        uint8_t code = next->raw[i];
+        if (!code || report_keyboard_has_key(waiting, code, size)) continue;
+        uint8_t j = 2;
+        while (j < size && waiting->raw[j]) j++;
+        if (j < size) {
+            waiting->raw[j] = code;
+        } else {
+            fit = false;
+        }
+    }
+    return fit;
+}
+
+static inline bool report_mouse_covers(const report_mouse_t *waiting, const report_mouse_t *next)
+{
+    return !(waiting->buttons & ~next->buttons);
+}
+
+static inline int8_t report_mouse_add(int8_t a, int8_t b)
+{
+    int16_t v = a + b;
+    return (v > 127) ? 127 : (v < -127) ? -127 : v;
+}
+
+/* buttons are added and movement of next is moved into waiting */
+static inline void report_mouse_merge(report_mouse_t *waiting, report_mouse_t *next)
+{
+    waiting->buttons |= next->buttons;
+    waiting->x = report_mouse_add(waiting->x, next->x);
+    waiting->y = report_mouse_add(waiting->y, next->y);
+    waiting->v = report_mouse_add(waiting->v, next->v);
+    waiting->h = report_mouse_add(waiting->h, next->h);
+    next->x = next->y = next->v = next->h = 0;
+}
+
+/* system and consumer report hold one usage, only a release can take press */
+static inline bool report_extra_covers(uint16_t waiting, uint16_t next)
+{
+    return !waiting || waiting == next;
+}
+
+
 /* keycode to system usage */
 #define KEYCODE2SYSTEM(key) \
     (key == KC_SYSTEM_POWER ? SYSTEM_POWER_DOWN : \
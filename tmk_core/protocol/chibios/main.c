@@ -36,6 +36,7 @@
 #endif
 #include "suspend.h"
 #include "hook.h"
+#include "timer.h"
 
 
 /* -------------------------
@@ -76,6 +77,92 @@ void hook_usb_suspend_loop(void) {
   }
 }
 
+/* -------------------------
+ *   Keyboard threads
+ * -------------------------
+ */
+
+/* Scan thread scans matrix every SCAN_PERIOD_MS with higher priority than
+ * main thread, key events are passed through mailbox. Main thread runs
+ * actions and sends reports, so that waiting for USB transfers or console
+ * never delays scanning. Events stay in matrix while mailbox is full.
+ */
+#ifndef SCAN_PERIOD_MS
+#define SCAN_PERIOD_MS      1
+#endif
+#ifndef SCAN_THREAD_PRIO
+#define SCAN_THREAD_PRIO    (NORMALPRIO + 16)
+#endif
+#ifndef EVENT_MAILBOX_SIZE
+#define EVENT_MAILBOX_SIZE  16
+#endif
+
+#if MATRIX_ROWS > 128 || MATRIX_COLS > 128
+#error "Key event is packed in msg_t with 7 bits for row and col"
+#endif
+
+static msg_t event_buf[EVENT_MAILBOX_SIZE];
+static MAILBOX_DECL(event_mb, event_buf, EVENT_MAILBOX_SIZE);
+
+/* matrix is scanned by one thread at a time */
+static MUTEX_DECL(scan_mtx);
+
+keyboard_thread_stats_t keyboard_thread_stats;
+
+/* time(16) | row(7) | col(7) | pressed(1) */
+static msg_t event_pack(keyevent_t e) {
+  return ((msg_t)e.time << 15) | (e.key.row << 8) | (e.key.col << 1) | e.pressed;
+}
+
+static keyevent_t event_unpack(msg_t msg) {
+  return (keyevent_t){
+    .key = (keypos_t){ .row = (msg >> 8) & 0x7F, .col = (msg >> 1) & 0x7F },
+    .pressed = msg & 1,
+    .time = (msg >> 15) & 0xFFFF
+  };
+}
+
+static THD_WORKING_AREA(waScanThread, 256);
+static THD_FUNCTION(scanThread, arg) {
+  (void)arg;
+  chRegSetThreadName("scan");
+
+  systime_t last = chVTGetSystemTime();
+  while(true) {
+    systime_t start = chVTGetSystemTime();
+    keyevent_t e;
+    cnt_t free;
+
+    chMtxLock(&scan_mtx);
+    /* suspend loop checks matrix by itself */
+    if(USB_DRIVER.state != USB_SUSPENDED) {
+      keyboard_scan();
+      chSysLock();
+      free = chMBGetFreeCountI(&event_mb);
+      chSysUnlock();
+      if(free == 0)
+        keyboard_thread_stats.mailbox_full++;
+      while(free > 0 && keyboard_event(&e)) {
+        chMBPost(&event_mb, event_pack(e), TIME_IMMEDIATE);
+        free--;
+      }
+      if(EVENT_MAILBOX_SIZE - free > keyboard_thread_stats.mailbox_max)
+        keyboard_thread_stats.mailbox_max = EVENT_MAILBOX_SIZE - free;
+    }
+    chMtxUnlock(&scan_mtx);
+
+    systime_t end = chVTGetSystemTime();
+    if(ST2US(end - start) > keyboard_thread_stats.scan_time_max)
+      keyboard_thread_stats.scan_time_max = ST2US(end - start);
+    if(ST2US(start - last) > keyboard_thread_stats.scan_gap_max)
+      keyboard_thread_stats.scan_gap_max = ST2US(start - last);
+    last = start;
+
+    /* fixed period from start of scan, no sleep when it is overrun */
+    chThdSleepUntilWindowed(start, start + MS2ST(SCAN_PERIOD_MS));
+  }
+}
+
 /* TESTING
  * Amber LED blinker thread, times are in milliseconds.
  */
@@ -141,13 +228,17 @@ int main(void) {
 
   hook_late_init();
 
+  chThdCreateStatic(waScanThread, sizeof(waScanThread), SCAN_THREAD_PRIO, scanThread, NULL);
+
   /* Main loop */
   while(true) {
 
     if(USB_DRIVER.state == USB_SUSPENDED) {
       print("[s]");
       while(USB_DRIVER.state == USB_SUSPENDED) {
+        chMtxLock(&scan_mtx);
         hook_usb_suspend_loop();
+        chMtxUnlock(&scan_mtx);
       }
       /* Woken up */
       // variables have been already cleared
@@ -157,6 +248,18 @@ int main(void) {
 #endif /* MOUSEKEY_ENABLE */
     }
 
-    keyboard_task();
+    /* key event from scan thread, or tick when none comes within 1ms */
+    msg_t msg;
+    if(chMBFetch(&event_mb, &msg, MS2ST(1)) == MSG_OK) {
+      keyevent_t e = event_unpack(msg);
+      uint16_t delay = timer_elapsed(e.time);
+      if(delay > keyboard_thread_stats.event_delay_max)
+        keyboard_thread_stats.event_delay_max = delay;
+      action_exec(e);
+      hook_matrix_change(e);
+    } else {
+      action_exec(TICK);
+    }
+    keyboard_routine();
   }
 }
@@ -15,6 +15,8 @@
  * GPL v2 or later.
  */
 
+#include <string.h>
+
 #include "ch.h"
 #include "hal.h"
 
@@ -70,6 +72,46 @@ report_mouse_t mouse_report_blank = {0};
 uint8_t extra_report_blank[3] = {0};
 #endif /* EXTRAKEY_ENABLE */
 
+/* Each report endpoint has a ring of three buffers: one may be in
+ * transmission and up to two wait for it, so that callers never block.
+ * A newer report replaces the last waiting one only if it covers it (see
+ * report.h), otherwise it waits after it. When two are waiting already the
+ * presses of the second are merged into the first. A press can still be lost
+ * there when the keys don't fit in 6KRO report, or when system or consumer
+ * reports with two different usages are waiting; report_stats.lost counts
+ * those. Waiting report is started from IN callback. */
+#define REPORT_BUFFERS 3
+
+typedef enum {
+  REPORT_KEYBOARD,
+  REPORT_NKRO,
+  REPORT_MOUSE,
+  REPORT_EXTRA
+} report_kind_t;
+
+typedef struct {
+  usbep_t ep;
+  report_kind_t kind;
+  uint8_t first;          /* buf[first] is sent next, the one before may be in transmission */
+  uint8_t count;          /* reports waiting, up to REPORT_BUFFERS - 1 */
+  uint8_t size[REPORT_BUFFERS];
+  uint8_t buf[REPORT_BUFFERS][sizeof(report_keyboard_t)];
+} report_buffer_t;
+
+report_stats_t report_stats;
+static report_buffer_t kbd_buffer = { .ep = KBD_ENDPOINT, .kind = REPORT_KEYBOARD };
+#ifdef NKRO_ENABLE
+static report_buffer_t nkro_buffer = { .ep = NKRO_ENDPOINT, .kind = REPORT_NKRO };
+#endif /* NKRO_ENABLE */
+#ifdef MOUSE_ENABLE
+static report_buffer_t mouse_buffer = { .ep = MOUSE_ENDPOINT, .kind = REPORT_MOUSE };
+#endif /* MOUSE_ENABLE */
+#ifdef EXTRAKEY_ENABLE
+/* system and consumer share endpoint, each has its own reports waiting */
+static report_buffer_t system_buffer = { .ep = EXTRA_ENDPOINT, .kind = REPORT_EXTRA };
+static report_buffer_t consumer_buffer = { .ep = EXTRA_ENDPOINT, .kind = REPORT_EXTRA };
+#endif /* EXTRAKEY_ENABLE */
+
 #ifdef CONSOLE_ENABLE
 /* The emission buffers queue */
 output_buffers_queue_t console_buf_queue;
@@ -787,6 +829,7 @@ static void usb_event_cb(USBDriver *usbp, usbevent_t event) {
   switch(event) {
   case USB_EVENT_RESET:
     //TODO: from ISR! print("[R]");
+    host_clear_last_reports();
     return;
 
   case USB_EVENT_ADDRESS:
@@ -794,6 +837,19 @@ static void usb_event_cb(USBDriver *usbp, usbevent_t event) {
 
   case USB_EVENT_CONFIGURED:
     osalSysLockFromISR();
+    /* reports waiting from previous configuration are stale */
+    kbd_buffer.count = 0;
+#ifdef NKRO_ENABLE
+    nkro_buffer.count = 0;
+#endif /* NKRO_ENABLE */
+#ifdef MOUSE_ENABLE
+    mouse_buffer.count = 0;
+#endif /* MOUSE_ENABLE */
+#ifdef EXTRAKEY_ENABLE
+    system_buffer.count = 0;
+    consumer_buffer.count = 0;
+#endif /* EXTRAKEY_ENABLE */
+    host_clear_last_reports();
     /* Enable the endpoints specified into the configuration. */
     usbInitEndpointI(usbp, KBD_ENDPOINT, &kbd_ep_config);
 #ifdef MOUSE_ENABLE
@@ -1059,6 +1115,105 @@ void send_remote_wakeup(USBDriver *usbp) {
 #endif /* K20x || KL2x */
 }
 
+/* ---------------------------------------------------------
+ *                  Report buffer functions
+ * ---------------------------------------------------------
+ */
+
+static uint8_t report_index(report_buffer_t *rb, uint8_t i) {
+  return (rb->first + i) % REPORT_BUFFERS;
+}
+
+/* start the waiting report if the endpoint is free
+ * called from a locked state */
+static bool report_startI(report_buffer_t *rb) {
+  if(!rb->count || usbGetTransmitStatusI(&USB_DRIVER, rb->ep))
+    return false;
+  usbStartTransmitI(&USB_DRIVER, rb->ep, rb->buf[rb->first], rb->size[rb->first]);
+  rb->first = report_index(rb, 1);
+  rb->count--;
+  return true;
+}
+
+/* waiting report i can be replaced by report */
+static bool report_covers(report_buffer_t *rb, uint8_t i, const void *report) {
+  switch(rb->kind) {
+  case REPORT_KEYBOARD:
+  case REPORT_NKRO:
+    return report_keyboard_covers((report_keyboard_t *)rb->buf[i], report,
+                                  rb->size[i], rb->kind == REPORT_NKRO);
+  case REPORT_MOUSE:
+    return report_mouse_covers((report_mouse_t *)rb->buf[i], report);
+  case REPORT_EXTRA:
+    return report_extra_covers(((report_extra_t *)rb->buf[i])->usage,
+                               ((const report_extra_t *)report)->usage);
+  }
+  return false;
+}
+
+/* add keys and movement of waiting report j to i, false when a press is lost */
+static bool report_merge(report_buffer_t *rb, uint8_t i, uint8_t j) {
+  switch(rb->kind) {
+  case REPORT_KEYBOARD:
+  case REPORT_NKRO:
+    return report_keyboard_merge((report_keyboard_t *)rb->buf[i], (report_keyboard_t *)rb->buf[j],
+                                 rb->size[i], rb->kind == REPORT_NKRO);
+  case REPORT_MOUSE:
+    report_mouse_merge((report_mouse_t *)rb->buf[i], (report_mouse_t *)rb->buf[j]);
+    return true;
+  case REPORT_EXTRA: {
+    report_extra_t *waiting = (report_extra_t *)rb->buf[i];
+    const report_extra_t *next = (const report_extra_t *)rb->buf[j];
+    if(!waiting->usage) {
+      /* release in between is dropped, press of next is sent in its place */
+      waiting->usage = next->usage;
+      return true;
+    }
+    return report_extra_covers(next->usage, waiting->usage);
+  }
+  }
+  return false;
+}
+
+/* copy report into the buffer and start it if possible
+ * called from a locked state, returns false when dropped */
+static bool report_putI(report_buffer_t *rb, const void *report, uint8_t size) {
+  if(usbGetDriverStateI(&USB_DRIVER) != USB_ACTIVE) {
+    report_stats.dropped++;
+    return false;
+  }
+  report_stats.queued++;
+  if(rb->count) {
+    uint8_t last = report_index(rb, rb->count - 1);
+    if(report_covers(rb, last, report)) {
+      report_stats.coalesced++;
+      if(rb->kind == REPORT_MOUSE) {
+        /* movement is relative, add up instead of replacing */
+        report_mouse_t r = *(const report_mouse_t *)report;
+        report_mouse_merge(&r, (report_mouse_t *)rb->buf[last]);
+        memcpy(rb->buf[last], &r, size);
+      } else {
+        memcpy(rb->buf[last], report, size);
+      }
+      report_startI(rb);
+      return true;
+    }
+    if(rb->count == REPORT_BUFFERS - 1) {
+      /* keep presses of second waiting report in first, its releases wait */
+      report_stats.merged++;
+      if(!report_merge(rb, rb->first, last))
+        report_stats.lost++;
+      rb->count--;
+    }
+  }
+  uint8_t i = report_index(rb, rb->count);
+  memcpy(rb->buf[i], report, size);
+  rb->size[i] = size;
+  rb->count++;
+  report_startI(rb);
+  return true;
+}
+
 /* ---------------------------------------------------------
  *                  Keyboard functions
  * ---------------------------------------------------------
@@ -1066,17 +1221,21 @@ void send_remote_wakeup(USBDriver *usbp) {
 
 /* keyboard IN callback hander (a kbd report has made it IN) */
 void kbd_in_cb(USBDriver *usbp, usbep_t ep) {
-  /* STUB */
   (void)usbp;
   (void)ep;
+  osalSysLockFromISR();
+  report_startI(&kbd_buffer);
+  osalSysUnlockFromISR();
 }
 
 #ifdef NKRO_ENABLE
 /* nkro IN callback hander (a nkro report has made it IN) */
 void nkro_in_cb(USBDriver *usbp, usbep_t ep) {
-  /* STUB */
   (void)usbp;
   (void)ep;
+  osalSysLockFromISR();
+  report_startI(&nkro_buffer);
+  osalSysUnlockFromISR();
 }
 #endif /* NKRO_ENABLE */
 
@@ -1107,8 +1266,9 @@ static void keyboard_idle_timer_cb(void *arg) {
   if(keyboard_idle) {
 #endif /* NKRO_ENABLE */
     /* TODO: are we sure we want the KBD_ENDPOINT? */
-    if(!usbGetTransmitStatusI(usbp, KBD_ENDPOINT)) {
-      usbStartTransmitI(usbp, KBD_ENDPOINT, (uint8_t *)&keyboard_report_sent, KBD_EPSIZE);
+    /* waiting report is newer than the one to repeat */
+    if(!kbd_buffer.count) {
+      report_putI(&kbd_buffer, &keyboard_report_sent, KBD_EPSIZE);
     }
     /* rearm the timer */
     chVTSetI(&keyboard_idle_timer, 4*MS2ST(keyboard_idle), keyboard_idle_timer_cb, (void *)usbp);
@@ -1124,50 +1284,24 @@ uint8_t keyboard_leds(void) {
   return (uint8_t)(keyboard_led_stats & 0xFF);
 }
 
-/* prepare and start sending a report IN
+/* queue a report IN, the caller doesn't wait for transfer
  * not callable from ISR or locked state */
 void send_keyboard(report_keyboard_t *report) {
-  osalSysLock();
-  if(usbGetDriverStateI(&USB_DRIVER) != USB_ACTIVE) {
-    osalSysUnlock();
-    return;
-  }
-  osalSysUnlock();
+  bool queued;
 
+  osalSysLock();
 #ifdef NKRO_ENABLE
   if(keyboard_nkro) {  /* NKRO protocol */
-    /* need to wait until the previous packet has made it through */
-    /* can rewrite this using the synchronous API, then would wait
-     * until *after* the packet has been transmitted. I think
-     * this is more efficient */
-    /* busy wait, should be short and not very common */
-    osalSysLock();
-    if(usbGetTransmitStatusI(&USB_DRIVER, NKRO_ENDPOINT)) {
-      /* Need to either suspend, or loop and call unlock/lock during
-       * every iteration - otherwise the system will remain locked,
-       * no interrupts served, so USB not going through as well.
-       * Note: for suspend, need USB_USE_WAIT == TRUE in halconf.h */
-      osalThreadSuspendS(&(&USB_DRIVER)->epc[NKRO_ENDPOINT]->in_state->thread);
-    }
-    usbStartTransmitI(&USB_DRIVER, NKRO_ENDPOINT, (uint8_t *)report, sizeof(report_keyboard_t));
-    osalSysUnlock();
+    queued = report_putI(&nkro_buffer, report, sizeof(report_keyboard_t));
   } else
 #endif /* NKRO_ENABLE */
   { /* boot protocol */
-    /* need to wait until the previous packet has made it through */
-    /* busy wait, should be short and not very common */
-    osalSysLock();
-    if(usbGetTransmitStatusI(&USB_DRIVER, KBD_ENDPOINT)) {
-      /* Need to either suspend, or loop and call unlock/lock during
-       * every iteration - otherwise the system will remain locked,
-       * no interrupts served, so USB not going through as well.
-       * Note: for suspend, need USB_USE_WAIT == TRUE in halconf.h */
-      osalThreadSuspendS(&(&USB_DRIVER)->epc[KBD_ENDPOINT]->in_state->thread);
-    }
-    usbStartTransmitI(&USB_DRIVER, KBD_ENDPOINT, (uint8_t *)report, KBD_EPSIZE);
-    osalSysUnlock();
+    queued = report_putI(&kbd_buffer, report, KBD_EPSIZE);
   }
-  keyboard_report_sent = *report;
+  if(queued) {
+    keyboard_report_sent = *report;
+  }
+  osalSysUnlock();
 }
 
 /* ---------------------------------------------------------
@@ -1181,23 +1315,14 @@ void send_keyboard(report_keyboard_t *report) {
 void mouse_in_cb(USBDriver *usbp, usbep_t ep) {
   (void)usbp;
   (void)ep;
+  osalSysLockFromISR();
+  report_startI(&mouse_buffer);
+  osalSysUnlockFromISR();
 }
 
 void send_mouse(report_mouse_t *report) {
   osalSysLock();
-  if(usbGetDriverStateI(&USB_DRIVER) != USB_ACTIVE) {
-    osalSysUnlock();
-    return;
-  }
-  osalSysUnlock();
-
-  /* TODO: LUFA manually waits for the endpoint to become ready
-   * for about 10ms for mouse, kbd, system; 1ms for nkro
-   * is this really needed?
-   */
-
-  osalSysLock();
-  usbStartTransmitI(&USB_DRIVER, MOUSE_ENDPOINT, (uint8_t *)report, sizeof(report_mouse_t));
+  report_putI(&mouse_buffer, report, sizeof(report_mouse_t));
   osalSysUnlock();
 }
 
@@ -1216,33 +1341,32 @@ void send_mouse(report_mouse_t *report) {
 
 /* extrakey IN callback hander */
 void extra_in_cb(USBDriver *usbp, usbep_t ep) {
-  /* STUB */
   (void)usbp;
   (void)ep;
-}
-
-static void send_extra_report(uint8_t report_id, uint16_t data) {
-  osalSysLock();
-  if(usbGetDriverStateI(&USB_DRIVER) != USB_ACTIVE) {
-    osalSysUnlock();
-    return;
+  osalSysLockFromISR();
+  if(!report_startI(&system_buffer)) {
+    report_startI(&consumer_buffer);
   }
+  osalSysUnlockFromISR();
+}
 
+static void send_extra_report(report_buffer_t *rb, uint8_t report_id, uint16_t data) {
   report_extra_t report = {
     .report_id = report_id,
     .usage = data
   };
 
-  usbStartTransmitI(&USB_DRIVER, EXTRA_ENDPOINT, (uint8_t *)&report, sizeof(report_extra_t));
+  osalSysLock();
+  report_putI(rb, &report, sizeof(report_extra_t));
   osalSysUnlock();
 }
 
 void send_system(uint16_t data) {
-  send_extra_report(REPORT_ID_SYSTEM, data);
+  send_extra_report(&system_buffer, REPORT_ID_SYSTEM, data);
 }
 
 void send_consumer(uint16_t data) {
-  send_extra_report(REPORT_ID_CONSUMER, data);
+  send_extra_report(&consumer_buffer, REPORT_ID_CONSUMER, data);
 }
 
 #else /* EXTRAKEY_ENABLE */
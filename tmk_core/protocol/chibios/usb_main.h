@@ -63,6 +63,17 @@ void send_remote_wakeup(USBDriver *usbp);
 
 /* extern report_keyboard_t keyboard_report_sent; */
 
+/* reports given by host driver, shown by status command */
+typedef struct {
+  uint16_t queued;      /* put into endpoint buffer */
+  uint16_t coalesced;   /* replaced a waiting report it covers */
+  uint16_t merged;      /* waiting report merged to make room */
+  uint16_t lost;        /* press lost in merge */
+  uint16_t dropped;     /* USB not active */
+} report_stats_t;
+
+extern report_stats_t report_stats;
+
 /* keyboard IN request callback handler */
 void kbd_in_cb(USBDriver *usbp, usbep_t ep);
 
@@ -148,4 +159,20 @@ void console_in_cb(USBDriver *usbp, usbep_t ep);
 
 void sendchar_pf(void *p, char c);
 
+/* ----------------
+ * Keyboard threads
+ * ----------------
+ */
+
+/* timing of scan thread and main thread, shown by status command */
+typedef struct {
+  uint32_t scan_time_max;     /* longest matrix scan(us) */
+  uint32_t scan_gap_max;      /* longest interval between scan starts(us) */
+  uint16_t event_delay_max;   /* longest delay from scan to action of key event(ms) */
+  uint8_t  mailbox_max;       /* most key events queued */
+  uint16_t mailbox_full;      /* scans which found mailbox full */
+} keyboard_thread_stats_t;
+
+extern keyboard_thread_stats_t keyboard_thread_stats;
+
 #endif /* _USB_MAIN_H_ */
@@ -79,12 +79,20 @@ typedef struct
     USB_Descriptor_Endpoint_t             Console_OUTEndpoint;
 #endif
 
-#ifdef NKRO_ENABLE
+#if defined(NKRO_ENABLE) && !defined(NKRO_SHARED_ENABLE)
     // NKRO HID Interface
     USB_Descriptor_Interface_t            NKRO_Interface;
     USB_HID_Descriptor_HID_t              NKRO_HID;
     USB_Descriptor_Endpoint_t             NKRO_INEndpoint;
 #endif
+
+#ifdef RAW_ENABLE
+    // Raw HID Interface
+    USB_Descriptor_Interface_t            Raw_Interface;
+    USB_HID_Descriptor_HID_t              Raw_HID;
+    USB_Descriptor_Endpoint_t             Raw_INEndpoint;
+    USB_Descriptor_Endpoint_t             Raw_OUTEndpoint;
+#endif
 } USB_Descriptor_Configuration_t;
 
 
@@ -109,15 +117,21 @@ typedef struct
 #   define CONSOLE_INTERFACE        EXTRAKEY_INTERFACE
 #endif
 
-#ifdef NKRO_ENABLE
+#if defined(NKRO_ENABLE) && !defined(NKRO_SHARED_ENABLE)
 #   define NKRO_INTERFACE           (CONSOLE_INTERFACE + 1)
 #else
 #   define NKRO_INTERFACE           CONSOLE_INTERFACE
 #endif
 
+#ifdef RAW_ENABLE
+#   define RAW_INTERFACE            (NKRO_INTERFACE + 1)
+#else
+#   define RAW_INTERFACE            NKRO_INTERFACE
+#endif
+
 
 /* nubmer of interfaces */
-#define TOTAL_INTERFACES            (NKRO_INTERFACE + 1)
+#define TOTAL_INTERFACES            (RAW_INTERFACE + 1)
 
 
 // Endopoint number and size
@@ -137,17 +151,47 @@ typedef struct
 
 #ifdef CONSOLE_ENABLE
 #   define CONSOLE_IN_EPNUM         (EXTRAKEY_IN_EPNUM + 1)
-#   define CONSOLE_OUT_EPNUM        (EXTRAKEY_IN_EPNUM + 1)
-//#   define CONSOLE_OUT_EPNUM        (EXTRAKEY_IN_EPNUM + 2)
+/* AVR endpoint has one direction, OUT needs its own number to receive.
+ * Without a spare endpoint it shares IN number as before and is not used. */
+#   if defined(NKRO_ENABLE) && !defined(NKRO_SHARED_ENABLE)
+#       define CONSOLE_NKRO_EPS     1
+#   else
+#       define CONSOLE_NKRO_EPS     0
+#   endif
+#   ifdef RAW_ENABLE
+#       define CONSOLE_RAW_EPS      2
+#   else
+#       define CONSOLE_RAW_EPS      0
+#   endif
+#   if (EXTRAKEY_IN_EPNUM + 2 + CONSOLE_NKRO_EPS + CONSOLE_RAW_EPS) >= ENDPOINT_TOTAL_ENDPOINTS
+#       define CONSOLE_OUT_EPNUM    CONSOLE_IN_EPNUM
+#   else
+#       define CONSOLE_OUT_EPNUM    (EXTRAKEY_IN_EPNUM + 2)
+#   endif
 #else
 #   define CONSOLE_OUT_EPNUM        EXTRAKEY_IN_EPNUM
 #endif
 
-#ifdef NKRO_ENABLE
+#if defined(NKRO_ENABLE) && !defined(NKRO_SHARED_ENABLE)
 #   define NKRO_IN_EPNUM            (CONSOLE_OUT_EPNUM + 1)
 #   if defined(__AVR_ATmega32U2__) && NKRO_IN_EPNUM > 4
 #       error "Endpoints are not available enough to support all functions. Remove some in Makefile.(MOUSEKEY, EXTRAKEY, CONSOLE, NKRO)"
 #   endif
+#elif defined(NKRO_ENABLE)
+/* NKRO bitmap in report protocol on keyboard endpoint */
+#   define NKRO_IN_EPNUM            KEYBOARD_IN_EPNUM
+#endif
+
+#ifdef RAW_ENABLE
+#   if defined(NKRO_ENABLE) && !defined(NKRO_SHARED_ENABLE)
+#       define RAW_IN_EPNUM         (NKRO_IN_EPNUM + 1)
+#   else
+#       define RAW_IN_EPNUM         (CONSOLE_OUT_EPNUM + 1)
+#   endif
+#   define RAW_OUT_EPNUM            (RAW_IN_EPNUM + 1)
+#   if RAW_OUT_EPNUM >= ENDPOINT_TOTAL_ENDPOINTS
+#       error "Endpoints are not available enough to support all functions. Remove some in Makefile.(MOUSEKEY, EXTRAKEY, CONSOLE, NKRO, RAW)"
+#   endif
 #endif
 
 
@@ -156,6 +200,16 @@ typedef struct
 #define EXTRAKEY_EPSIZE             8
 #define CONSOLE_EPSIZE              32
 #define NKRO_EPSIZE                 32
+#define RAW_EPSIZE                  32
+
+#ifdef NKRO_SHARED_ENABLE
+#   ifndef NKRO_ENABLE
+#       error "NKRO_SHARED_ENABLE requires NKRO_ENABLE"
+#   endif
+#   define KEYBOARD_IN_EPSIZE       NKRO_EPSIZE
+#else
+#   define KEYBOARD_IN_EPSIZE       KEYBOARD_EPSIZE
+#endif
 
 
 uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
@@ -41,6 +41,7 @@
 #include "host_driver.h"
 #include "keyboard.h"
 #include "action.h"
+#include "action_util.h"
 #include "led.h"
 #include "sendchar.h"
 #include "debug.h"
@@ -49,6 +50,11 @@
 #endif
 #include "suspend.h"
 #include "hook.h"
+#include "timer.h"
+#include "command.h"
+#ifdef RAW_ENABLE
+#include "raw_hid.h"
+#endif
 
 #ifdef LUFA_DEBUG_SUART
 #include "avr/suart.h"
@@ -68,6 +74,53 @@ uint8_t keyboard_protocol = 1;
 static uint8_t keyboard_led_stats = 0;
 
 static report_keyboard_t keyboard_report_sent;
+static uint8_t keyboard_report_ep;
+static volatile uint8_t keyboard_report_size = 0;   /* 0: nothing sent yet */
+
+/* Boot timeline(ms since timer start at beginning of main(), 0: not yet) */
+static struct {
+    uint16_t init;          /* keyboard_init() done */
+    uint16_t scan;          /* first matrix scan done */
+    volatile uint16_t configured;   /* USB configured by host */
+    uint16_t report;        /* first report can be sent */
+} boot_time;
+
+/* Worst-case duration of USB event handlers run in interrupt(timer ticks) */
+static uint16_t usb_isr_ticks_max = 0;
+
+typedef struct {
+    uint8_t ms;
+    uint8_t raw;
+} usb_isr_stamp_t;
+
+/* Timer interrupt is blocked while in USB interrupt, so a pending compare
+ * match is counted as the ms it is going to add. */
+static usb_isr_stamp_t usb_isr_stamp(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    usb_isr_stamp_t t = { .ms = timer_count, .raw = TIMER_RAW };
+    if ((TIFR0 & _BV(OCF0A)) && t.raw < TIMER_RAW_TOP / 2) t.ms++;
+    SREG = sreg;
+    return t;
+}
+
+/* In interrupt the ms count stops, and one pending match is all that shows
+ * more. A handler over 2ms is still seen over 1ms, a negative one saturates. */
+static void usb_isr_time(usb_isr_stamp_t start)
+{
+    usb_isr_stamp_t end = usb_isr_stamp();
+    /* timer counts 0 to TIMER_RAW_TOP in 1ms */
+    int32_t ticks = (int32_t)(uint8_t)(end.ms - start.ms) * (TIMER_RAW_TOP + 1) + end.raw - start.raw;
+    if (ticks < 0 || ticks > UINT16_MAX) ticks = UINT16_MAX;
+    if (ticks > usb_isr_ticks_max) usb_isr_ticks_max = ticks;
+}
+
+uint16_t usb_isr_max(void)
+{
+    uint32_t us = (uint32_t)usb_isr_ticks_max * 1000 / (TIMER_RAW_TOP + 1);
+    return (us > UINT16_MAX) ? UINT16_MAX : us;
+}
 
 
 /* Host driver */
@@ -76,6 +129,7 @@ static void send_keyboard(report_keyboard_t *report);
 static void send_mouse(report_mouse_t *report);
 static void send_system(uint16_t data);
 static void send_consumer(uint16_t data);
+static void report_flush_held(void);
 host_driver_t lufa_driver = {
     keyboard_leds,
     send_keyboard,
@@ -85,10 +139,258 @@ host_driver_t lufa_driver = {
 };
 
 
+/*******************************************************************************
+ * Held reports
+ *
+ * A report which finds both banks of its endpoint busy is held here and
+ * written on start of frame as soon as the host has taken one, so that
+ * send_keyboard()/send_mouse() etc. never wait for the host. A newer report
+ * replaces the last held one only if it covers it(see report.h), otherwise it
+ * is held after it. When both slots are used presses of the second are merged
+ * into the first to make room. A press is lost there only when keys don't fit
+ * in 6KRO report, or when two different system or consumer usages are held.
+ ******************************************************************************/
+typedef enum {
+    HELD_KEYBOARD,
+    HELD_MOUSE,
+    HELD_EXTRA,
+} held_kind_t;
+
+typedef struct {
+    held_kind_t kind;
+    volatile uint8_t count;     /* reports held, slot[0] is written first */
+    uint8_t ep[2];
+    uint8_t size[2];
+    uint16_t time[2];           /* when report was given by send_*() */
+    uint8_t *slot[2];
+} held_report_t;
+
+#define HELD_REPORT(name, kind, type) \
+    static type name##_buf[2]; \
+    static held_report_t name = { kind, 0, {}, {}, {}, { (uint8_t *)&name##_buf[0], (uint8_t *)&name##_buf[1] } }
+
+HELD_REPORT(keyboard_held, HELD_KEYBOARD, report_keyboard_t);
+#ifdef MOUSE_ENABLE
+HELD_REPORT(mouse_held, HELD_MOUSE, report_mouse_t);
+#endif
+#ifdef EXTRAKEY_ENABLE
+HELD_REPORT(system_held, HELD_EXTRA, report_extra_t);
+HELD_REPORT(consumer_held, HELD_EXTRA, report_extra_t);
+#endif
+
+/* Longest time a report waited for endpoint(ms) */
+static uint16_t report_latency_ms_max = 0;
+
+uint16_t usb_report_latency_max(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t ms = report_latency_ms_max;
+    SREG = sreg;
+    return ms;
+}
+
+/* returns false when no bank of endpoint is free */
+static bool report_write(uint8_t ep, const void *data, uint8_t size)
+{
+    Endpoint_SelectEndpoint(ep);
+    if (!Endpoint_IsReadWriteAllowed()) return false;
+
+    Endpoint_Write_Stream_LE(data, size, NULL);
+    Endpoint_ClearIN();
+    return true;
+}
+
+static void report_flush(held_report_t *held)
+{
+    while (held->count && report_write(held->ep[0], held->slot[0], held->size[0])) {
+        uint16_t ms = TIMER_DIFF_16(timer_read(), held->time[0]);
+        if (ms > report_latency_ms_max) report_latency_ms_max = ms;
+
+        uint8_t *p = held->slot[0];
+        held->slot[0] = held->slot[1];
+        held->slot[1] = p;
+        held->ep[0] = held->ep[1];
+        held->size[0] = held->size[1];
+        held->time[0] = held->time[1];
+        held->count--;
+    }
+}
+
+// called from start of frame interrupt
+static void report_flush_held(void)
+{
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+
+    uint8_t ep = Endpoint_GetCurrentEndpoint();
+    report_flush(&keyboard_held);
+#ifdef MOUSE_ENABLE
+    report_flush(&mouse_held);
+#endif
+#ifdef EXTRAKEY_ENABLE
+    report_flush(&system_held);
+    report_flush(&consumer_held);
+#endif
+    Endpoint_SelectEndpoint(ep);
+}
+
+static void report_held_clear(void)
+{
+    keyboard_held.count = 0;
+#ifdef MOUSE_ENABLE
+    mouse_held.count = 0;
+#endif
+#ifdef EXTRAKEY_ENABLE
+    system_held.count = 0;
+    consumer_held.count = 0;
+#endif
+}
+
+/* held report i can be replaced by data */
+static bool held_covers(held_report_t *held, uint8_t i, const void *data, uint8_t ep, uint8_t size)
+{
+    if (held->ep[i] != ep || held->size[i] != size) return false;
+
+    switch (held->kind) {
+        case HELD_KEYBOARD:
+            return report_keyboard_covers((report_keyboard_t *)held->slot[i], data,
+                                          size, size > KEYBOARD_EPSIZE);
+        case HELD_MOUSE:
+            return report_mouse_covers((report_mouse_t *)held->slot[i], data);
+        case HELD_EXTRA:
+            return report_extra_covers(((report_extra_t *)held->slot[i])->usage,
+                                       ((const report_extra_t *)data)->usage);
+    }
+    return false;
+}
+
+/* add keys and movement of held report 1 to 0, false when a press is lost */
+static bool held_merge(held_report_t *held)
+{
+    if (held->ep[0] != held->ep[1] || held->size[0] != held->size[1]) return false;
+
+    switch (held->kind) {
+        case HELD_KEYBOARD:
+            return report_keyboard_merge((report_keyboard_t *)held->slot[0], (report_keyboard_t *)held->slot[1],
+                                         held->size[0], held->size[0] > KEYBOARD_EPSIZE);
+        case HELD_MOUSE:
+            report_mouse_merge((report_mouse_t *)held->slot[0], (report_mouse_t *)held->slot[1]);
+            return true;
+        case HELD_EXTRA: {
+            report_extra_t *waiting = (report_extra_t *)held->slot[0];
+            const report_extra_t *next = (const report_extra_t *)held->slot[1];
+            if (!waiting->usage) {
+                /* release in between is dropped, press of next is sent in its place */
+                waiting->usage = next->usage;
+                return true;
+            }
+            return report_extra_covers(next->usage, waiting->usage);
+        }
+    }
+    return false;
+}
+
+/* write report or hold it, never waits for host
+ * returns false when a press of older held report is lost */
+static bool report_send(held_report_t *held, uint8_t ep, const void *data, uint8_t size)
+{
+    bool kept = true;
+    uint8_t sreg = SREG;
+    cli();
+    if (!held->count) {
+        if (!report_write(ep, data, size)) {
+            held->ep[0] = ep;
+            held->size[0] = size;
+            held->time[0] = timer_read();
+            memcpy(held->slot[0], data, size);
+            held->count = 1;
+        }
+    } else {
+        uint8_t last = held->count - 1;
+        if (held_covers(held, last, data, ep, size)) {
+            if (held->kind == HELD_MOUSE) {
+                /* movement is relative, add up instead of replacing */
+                report_mouse_t r = *(const report_mouse_t *)data;
+                report_mouse_merge(&r, (report_mouse_t *)held->slot[last]);
+                memcpy(held->slot[last], &r, size);
+            } else {
+                memcpy(held->slot[last], data, size);
+            }
+        } else {
+            if (held->count == 2) {
+                kept = held_merge(held);
+            }
+            held->ep[1] = ep;
+            held->size[1] = size;
+            held->time[1] = timer_read();
+            memcpy(held->slot[1], data, size);
+            held->count = 2;
+        }
+    }
+    SREG = sreg;
+    return kept;
+}
+
+/* Idle rate: last keyboard report is repeated every keyboard_idle*4ms while
+ * no new report is sent. Counted in ms on start of frame.
+ */
+static volatile uint16_t keyboard_idle_count = 0;
+
+// called from start of frame interrupt
+static void keyboard_idle_repeat(void)
+{
+    if (!keyboard_idle || !keyboard_report_size)
+        return;
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+    if (++keyboard_idle_count < (uint16_t)keyboard_idle * 4)
+        return;
+    /* held report goes first and restarts the period */
+    if (keyboard_held.count)
+        return;
+
+    uint8_t ep = Endpoint_GetCurrentEndpoint();
+    if (report_write(keyboard_report_ep, &keyboard_report_sent, keyboard_report_size)) {
+        keyboard_idle_count = 0;
+    }
+    Endpoint_SelectEndpoint(ep);
+}
+
 /*******************************************************************************
  * Console
  ******************************************************************************/
 #ifdef CONSOLE_ENABLE
+/* Output is queued here by sendchar() and sent by Console_Task() on start of
+ * frame, so that print never waits for host. Chars are dropped when full.
+ */
+#ifndef CONSOLE_BUFFER_SIZE
+#define CONSOLE_BUFFER_SIZE 128
+#endif
+#define CONSOLE_BUFFER_MASK (CONSOLE_BUFFER_SIZE - 1)
+#if (CONSOLE_BUFFER_SIZE & CONSOLE_BUFFER_MASK) || CONSOLE_BUFFER_SIZE > 128
+#error "CONSOLE_BUFFER_SIZE must be power of two and 128 or less"
+#endif
+static uint8_t console_buf[CONSOLE_BUFFER_SIZE];
+static volatile uint8_t console_head = 0;
+static uint8_t console_tail = 0;
+static uint8_t console_head_last = 0;
+static uint16_t console_drop = 0;
+
+/* Input packet from host, processed in main loop */
+static uint8_t console_in[CONSOLE_EPSIZE];
+static volatile uint8_t console_in_len = 0;
+
+uint16_t console_dropped(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t n = console_drop;
+    SREG = sreg;
+    return n;
+}
+
+// called every 1ms
 static void Console_Task(void)
 {
     /* Device must be connected and configured for the task to run */
@@ -97,28 +399,17 @@ static void Console_Task(void)
 
     uint8_t ep = Endpoint_GetCurrentEndpoint();
 
-#if 0
-    // TODO: impl receivechar()/recvchar()
+#if CONSOLE_OUT_EPNUM != CONSOLE_IN_EPNUM
+    /* OUT packet, left in bank until last one is processed */
     Endpoint_SelectEndpoint(CONSOLE_OUT_EPNUM);
-
-    /* Check to see if a packet has been sent from the host */
-    if (Endpoint_IsOUTReceived())
-    {
-        /* Check to see if the packet contains data */
-        if (Endpoint_IsReadWriteAllowed())
-        {
-            /* Create a temporary buffer to hold the read in report from the host */
-            uint8_t ConsoleData[CONSOLE_EPSIZE];
-
-            /* Read Console Report Data */
-            Endpoint_Read_Stream_LE(&ConsoleData, sizeof(ConsoleData), NULL);
-
-            /* Process Console Report Data */
-            //ProcessConsoleHIDReport(ConsoleData);
+    if (!console_in_len && Endpoint_IsOUTReceived()) {
+        uint8_t len = 0;
+        while (Endpoint_IsReadWriteAllowed() && len < CONSOLE_EPSIZE) {
+            uint8_t c = Endpoint_Read_8();
+            if (c) console_in[len++] = c;
         }
-
-        /* Finalize the stream transfer to send the last packet */
         Endpoint_ClearOUT();
+        console_in_len = len;
     }
 #endif
 
@@ -129,21 +420,80 @@ static void Console_Task(void)
         return;
     }
 
-    // fill empty bank
-    while (Endpoint_IsReadWriteAllowed())
-        Endpoint_Write_8(0);
-
-    // flash senchar packet
-    if (Endpoint_IsINReady()) {
+    /* send whole packet, or the rest once output pauses for a frame */
+    uint8_t head = console_head;
+    uint8_t count = head - console_tail;
+    if (count && Endpoint_IsINReady() &&
+            (count >= CONSOLE_EPSIZE || head == console_head_last)) {
+        for (uint8_t i = 0; i < CONSOLE_EPSIZE; i++) {
+            if (console_tail != head) {
+                Endpoint_Write_8(console_buf[console_tail++ & CONSOLE_BUFFER_MASK]);
+            } else {
+                Endpoint_Write_8(0);
+            }
+        }
         Endpoint_ClearIN();
     }
+    console_head_last = head;
 
     Endpoint_SelectEndpoint(ep);
 }
+
+/* Chars from host are taken as commands, see command_char() */
+static void console_recv_task(void)
+{
+    uint8_t len = console_in_len;
+    for (uint8_t i = 0; i < len; i++) {
+        command_char(console_in[i]);
+    }
+    console_in_len = 0;
+}
 #else
 static void Console_Task(void)
 {
 }
+static void console_recv_task(void)
+{
+}
+#endif
+
+
+/*******************************************************************************
+ * Raw HID
+ ******************************************************************************/
+#ifdef RAW_ENABLE
+/* Request is taken only when IN bank is free for its response, otherwise
+ * it is left in OUT bank and host waits. */
+static void Raw_Task(void)
+{
+    uint8_t data[RAW_EPSIZE];
+
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+
+    Endpoint_SelectEndpoint(RAW_IN_EPNUM);
+    if (!Endpoint_IsINReady())
+        return;
+
+    Endpoint_SelectEndpoint(RAW_OUT_EPNUM);
+    if (!Endpoint_IsOUTReceived())
+        return;
+
+    for (uint8_t i = 0; i < sizeof(data); i++) {
+        data[i] = Endpoint_IsReadWriteAllowed() ? Endpoint_Read_8() : 0;
+    }
+    Endpoint_ClearOUT();
+
+    raw_hid_receive(data, sizeof(data));
+
+    Endpoint_SelectEndpoint(RAW_IN_EPNUM);
+    Endpoint_Write_Stream_LE(data, sizeof(data), NULL);
+    Endpoint_ClearIN();
+}
+#else
+static void Raw_Task(void)
+{
+}
 #endif
 
 
@@ -188,6 +538,7 @@ void EVENT_USB_Device_Reset(void)
     print("[R]");
 #endif
     USB_IsInitialized = false;
+    host_clear_last_reports();
 }
 
 void EVENT_USB_Device_Suspend()
@@ -206,30 +557,28 @@ void EVENT_USB_Device_WakeUp()
     hook_usb_wakeup();
 }
 
-#ifdef CONSOLE_ENABLE
-static bool console_flush = false;
-#define CONSOLE_FLUSH_SET(b)   do { \
-    uint8_t sreg = SREG; cli(); console_flush = b; SREG = sreg; \
-} while (0)
-
 // called every 1ms
 void EVENT_USB_Device_StartOfFrame(void)
 {
-    static uint8_t count;
-    if (++count % 50) return;
-    count = 0;
-
-    if (!console_flush) return;
+    usb_isr_stamp_t start = usb_isr_stamp();
+    report_flush_held();
+    keyboard_idle_repeat();
     Console_Task();
-    console_flush = false;
+    usb_isr_time(start);
 }
+
+/* Keyboard and mouse reports use dual bank(ping-pong mode) so that two
+ * reports can be queued for the host. ATMega32u2 supports dual bank only on
+ * endpoint 3 and 4, it is safe to use single bank for all endpoints there.
+ */
+#if defined(__AVR_ATmega32U2__) || defined(__AVR_ATmega16U2__) || defined(__AVR_ATmega8U2__)
+#   define REPORT_BANK  ENDPOINT_BANK_SINGLE
+#else
+#   define REPORT_BANK  ENDPOINT_BANK_DOUBLE
 #endif
 
 /** Event handler for the USB_ConfigurationChanged event.
  * This is fired when the host sets the current configuration of the USB device after enumeration.
- *
- * ATMega32u2 supports dual bank(ping-pong mode) only on endpoint 3 and 4,
- * it is safe to use singl bank for all endpoints.
  */
 void EVENT_USB_Device_ConfigurationChanged(void)
 {
@@ -238,14 +587,22 @@ void EVENT_USB_Device_ConfigurationChanged(void)
 #endif
     bool ConfigSuccess = true;
 
+    if (!boot_time.configured) boot_time.configured = timer_read() | 1;
+
+    /* Discard reports held for old configuration */
+    report_held_clear();
+    keyboard_report_size = 0;
+    host_clear_last_reports();
+
     /* Setup Keyboard HID Report Endpoints */
     ConfigSuccess &= ENDPOINT_CONFIG(KEYBOARD_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
-                                     KEYBOARD_EPSIZE, ENDPOINT_BANK_SINGLE);
+                                     KEYBOARD_IN_EPSIZE, REPORT_BANK);
 
 #ifdef MOUSE_ENABLE
     /* Setup Mouse HID Report Endpoint */
+    mouse_resolution = 0;
     ConfigSuccess &= ENDPOINT_CONFIG(MOUSE_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
-                                     MOUSE_EPSIZE, ENDPOINT_BANK_SINGLE);
+                                     MOUSE_EPSIZE, REPORT_BANK);
 #endif
 
 #ifdef EXTRAKEY_ENABLE
@@ -258,19 +615,140 @@ void EVENT_USB_Device_ConfigurationChanged(void)
     /* Setup Console HID Report Endpoints */
     ConfigSuccess &= ENDPOINT_CONFIG(CONSOLE_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
                                      CONSOLE_EPSIZE, ENDPOINT_BANK_SINGLE);
-#if 0
+#if CONSOLE_OUT_EPNUM != CONSOLE_IN_EPNUM
     ConfigSuccess &= ENDPOINT_CONFIG(CONSOLE_OUT_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_OUT,
                                      CONSOLE_EPSIZE, ENDPOINT_BANK_SINGLE);
 #endif
 #endif
 
-#ifdef NKRO_ENABLE
+#if defined(NKRO_ENABLE) && !defined(NKRO_SHARED_ENABLE)
     /* Setup NKRO HID Report Endpoints */
     ConfigSuccess &= ENDPOINT_CONFIG(NKRO_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
-                                     NKRO_EPSIZE, ENDPOINT_BANK_SINGLE);
+                                     NKRO_EPSIZE, REPORT_BANK);
+#endif
+
+#ifdef RAW_ENABLE
+    /* Setup Raw HID Report Endpoints */
+    ConfigSuccess &= ENDPOINT_CONFIG(RAW_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
+                                     RAW_EPSIZE, ENDPOINT_BANK_SINGLE);
+    ConfigSuccess &= ENDPOINT_CONFIG(RAW_OUT_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_OUT,
+                                     RAW_EPSIZE, ENDPOINT_BANK_SINGLE);
 #endif
 }
 
+/*******************************************************************************
+ * Control transfer
+ *
+ * Class requests are only latched in the USB interrupt. Data and status
+ * stages are completed by Control_Task() in main loop as packets arrive, so
+ * that the interrupt handler never waits for the host.
+ ******************************************************************************/
+enum {
+    CONTROL_IDLE,
+    CONTROL_IN_DATA,        /* send control_data */
+    CONTROL_OUT_STATUS,     /* wait for host to acknowledge IN data */
+    CONTROL_OUT_DATA,       /* receive one byte into control_data */
+    CONTROL_IN_STATUS,      /* send zero length packet to acknowledge */
+};
+static volatile uint8_t control_stage = CONTROL_IDLE;
+static uint8_t *control_data;
+/* IN data is copied when request is latched, report may change meanwhile */
+static uint8_t control_buf[sizeof(report_keyboard_t)];
+static uint8_t control_size;
+static bool control_zlp;
+/* SetProtocol is applied in main loop */
+static volatile bool protocol_changed = false;
+
+/* called from USB interrupt */
+static void control_in(const uint8_t *data, uint8_t size)
+{
+    if (size > USB_ControlRequest.wLength) size = USB_ControlRequest.wLength;
+    if (size > sizeof(control_buf)) size = sizeof(control_buf);
+    memcpy(control_buf, data, size);
+    control_data = control_buf;
+    control_size = size;
+    /* short packet tells end of data when host asks more */
+    control_zlp = (size < USB_ControlRequest.wLength);
+    control_stage = CONTROL_IN_DATA;
+}
+
+static void control_out(uint8_t *data)
+{
+    control_data = data;
+    control_stage = CONTROL_OUT_DATA;
+}
+
+static void Control_Task(void)
+{
+    if (control_stage == CONTROL_IDLE && !protocol_changed)
+        return;
+
+    uint8_t sreg = SREG;
+    cli();
+    uint8_t ep = Endpoint_GetCurrentEndpoint();
+    Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+
+    /* new request from host aborts the transfer */
+    if (Endpoint_IsSETUPReceived())
+        goto done;
+
+    switch (control_stage) {
+        case CONTROL_IN_DATA:
+            if (Endpoint_IsOUTReceived()) {
+                /* host ended data stage early */
+                Endpoint_ClearOUT();
+                control_stage = CONTROL_IDLE;
+                break;
+            }
+            if (!Endpoint_IsINReady())
+                break;
+            if (control_size || control_zlp) {
+                uint8_t len = 0;
+                while (control_size && len < USB_Device_ControlEndpointSize) {
+                    Endpoint_Write_8(*control_data++);
+                    control_size--;
+                    len++;
+                }
+                Endpoint_ClearIN();
+                if (len < USB_Device_ControlEndpointSize)
+                    control_zlp = false;
+            } else {
+                control_stage = CONTROL_OUT_STATUS;
+            }
+            break;
+        case CONTROL_OUT_STATUS:
+            if (Endpoint_IsOUTReceived()) {
+                Endpoint_ClearOUT();
+                control_stage = CONTROL_IDLE;
+            }
+            break;
+        case CONTROL_OUT_DATA:
+            if (Endpoint_IsOUTReceived()) {
+                *control_data = Endpoint_Read_8();
+                Endpoint_ClearOUT();
+                control_stage = CONTROL_IN_STATUS;
+#ifdef LUFA_DEBUG
+                xprintf("[L%02X]", *control_data);
+#endif
+            }
+            break;
+        case CONTROL_IN_STATUS:
+            if (Endpoint_IsINReady()) {
+                Endpoint_ClearIN();
+                control_stage = CONTROL_IDLE;
+            }
+            break;
+    }
+done:
+    Endpoint_SelectEndpoint(ep);
+    SREG = sreg;
+
+    if (protocol_changed) {
+        protocol_changed = false;
+        clear_keyboard();
+    }
+}
+
 /*
 Appendix G: HID Request Support Requirements
 
@@ -286,11 +764,13 @@ Other Device    Required    Optional    Optional    Optional    Optional    Opti
 */
 /** Event handler for the USB_ControlRequest event.
  *  This is fired before passing along unhandled control requests to the library for processing internally.
+ *  Requests handled here are only latched, see Control_Task().
  */
 void EVENT_USB_Device_ControlRequest(void)
 {
-    uint8_t* ReportData = NULL;
-    uint8_t  ReportSize = 0;
+    usb_isr_stamp_t start = usb_isr_stamp();
+
+    control_stage = CONTROL_IDLE;
 
     /* Handle HID Class specific requests */
     switch (USB_ControlRequest.bRequest)
@@ -298,20 +778,33 @@ void EVENT_USB_Device_ControlRequest(void)
         case HID_REQ_GetReport:
             if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE))
             {
+                uint8_t* ReportData = NULL;
+                uint8_t  ReportSize = 0;
+
                 Endpoint_ClearSETUP();
 
                 // Interface
                 switch (USB_ControlRequest.wIndex) {
                 case KEYBOARD_INTERFACE:
-                    // TODO: test/check
+#if defined(NKRO_ENABLE) && !defined(NKRO_SHARED_ENABLE)
+                case NKRO_INTERFACE:
+#endif
+                    // latest report sent or held
                     ReportData = (uint8_t*)&keyboard_report_sent;
-                    ReportSize = sizeof(keyboard_report_sent);
+                    ReportSize = keyboard_report_size ? keyboard_report_size : KEYBOARD_EPSIZE;
+                    break;
+#ifdef MOUSE_ENABLE
+                case MOUSE_INTERFACE:
+                    // Resolution Multiplier
+                    if ((USB_ControlRequest.wValue >> 8) - 1 == HID_REPORT_ITEM_Feature) {
+                        ReportData = &mouse_resolution;
+                        ReportSize = sizeof(mouse_resolution);
+                    }
                     break;
+#endif
                 }
 
-                /* Write the report data to the control endpoint */
-                Endpoint_Write_Control_Stream_LE(ReportData, ReportSize);
-                Endpoint_ClearOUT();
+                control_in(ReportData, ReportSize);
 #ifdef LUFA_DEBUG
                 xprintf("[r%d]", USB_ControlRequest.wIndex);
 #endif
@@ -325,23 +818,20 @@ void EVENT_USB_Device_ControlRequest(void)
                 // Interface
                 switch (USB_ControlRequest.wIndex) {
                 case KEYBOARD_INTERFACE:
-#ifdef NKRO_ENABLE
+#if defined(NKRO_ENABLE) && !defined(NKRO_SHARED_ENABLE)
                 case NKRO_INTERFACE:
 #endif
                     Endpoint_ClearSETUP();
-
-                    while (!(Endpoint_IsOUTReceived())) {
-                        if (USB_DeviceState == DEVICE_STATE_Unattached)
-                          return;
-                    }
-                    keyboard_led_stats = Endpoint_Read_8();
-
-                    Endpoint_ClearOUT();
-                    Endpoint_ClearStatusStage();
-#ifdef LUFA_DEBUG
-                    xprintf("[L%d]", USB_ControlRequest.wIndex);
-#endif
+                    control_out(&keyboard_led_stats);
                     break;
+#ifdef MOUSE_ENABLE
+                case MOUSE_INTERFACE:
+                    if ((USB_ControlRequest.wValue >> 8) - 1 != HID_REPORT_ITEM_Feature)
+                        break;
+                    Endpoint_ClearSETUP();
+                    control_out(&mouse_resolution);
+                    break;
+#endif
                 }
 
             }
@@ -353,10 +843,7 @@ void EVENT_USB_Device_ControlRequest(void)
             {
                 if (USB_ControlRequest.wIndex == KEYBOARD_INTERFACE) {
                     Endpoint_ClearSETUP();
-                    while (!(Endpoint_IsINReady()));
-                    Endpoint_Write_8(keyboard_protocol);
-                    Endpoint_ClearIN();
-                    Endpoint_ClearStatusStage();
+                    control_in(&keyboard_protocol, sizeof(keyboard_protocol));
 #ifdef LUFA_DEBUG
                     print("[p]");
 #endif
@@ -369,10 +856,10 @@ void EVENT_USB_Device_ControlRequest(void)
             {
                 if (USB_ControlRequest.wIndex == KEYBOARD_INTERFACE) {
                     Endpoint_ClearSETUP();
-                    Endpoint_ClearStatusStage();
+                    control_stage = CONTROL_IN_STATUS;
 
                     keyboard_protocol = (USB_ControlRequest.wValue & 0xFF);
-                    clear_keyboard();
+                    protocol_changed = true;
 #ifdef LUFA_DEBUG
                     print("[P]");
 #endif
@@ -384,9 +871,18 @@ void EVENT_USB_Device_ControlRequest(void)
             if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE))
             {
                 Endpoint_ClearSETUP();
-                Endpoint_ClearStatusStage();
+                control_stage = CONTROL_IN_STATUS;
 
-                keyboard_idle = ((USB_ControlRequest.wValue & 0xFF00) >> 8);
+                /* idle rate is supported only on keyboard, others are accepted and ignored */
+                switch (USB_ControlRequest.wIndex) {
+                case KEYBOARD_INTERFACE:
+#if defined(NKRO_ENABLE) && !defined(NKRO_SHARED_ENABLE)
+                case NKRO_INTERFACE:
+#endif
+                    keyboard_idle = ((USB_ControlRequest.wValue & 0xFF00) >> 8);
+                    keyboard_idle_count = 0;
+                    break;
+                }
 #ifdef LUFA_DEBUG
                 xprintf("[I%d]%d", USB_ControlRequest.wIndex, (USB_ControlRequest.wValue & 0xFF00) >> 8);
 #endif
@@ -396,11 +892,19 @@ void EVENT_USB_Device_ControlRequest(void)
         case HID_REQ_GetIdle:
             if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE))
             {
+                static uint8_t idle_none = 0;
                 Endpoint_ClearSETUP();
-                while (!(Endpoint_IsINReady()));
-                Endpoint_Write_8(keyboard_idle);
-                Endpoint_ClearIN();
-                Endpoint_ClearStatusStage();
+                switch (USB_ControlRequest.wIndex) {
+                case KEYBOARD_INTERFACE:
+#if defined(NKRO_ENABLE) && !defined(NKRO_SHARED_ENABLE)
+                case NKRO_INTERFACE:
+#endif
+                    control_in(&keyboard_idle, sizeof(keyboard_idle));
+                    break;
+                default:
+                    control_in(&idle_none, sizeof(idle_none));
+                    break;
+                }
 #ifdef LUFA_DEBUG
                 print("[i]");
 #endif
@@ -408,6 +912,7 @@ void EVENT_USB_Device_ControlRequest(void)
 
             break;
     }
+    usb_isr_time(start);
 }
 
 /*******************************************************************************
@@ -418,109 +923,95 @@ static uint8_t keyboard_leds(void)
     return keyboard_led_stats;
 }
 
+#ifdef NKRO_SHARED_ENABLE
+/* Host in report protocol expects bitmap on shared interface even if NKRO
+ * is turned off, keys of 6KRO report are put in it. */
+static report_keyboard_t *keyboard_report_bitmap(report_keyboard_t *report)
+{
+    static report_keyboard_t bitmap;
+
+    bitmap = (report_keyboard_t){ .nkro.mods = report->mods };
+    for (uint8_t i = 0; i < KEYBOARD_EPSIZE - 2; i++) {
+        uint8_t code = report->keys[i];
+        if (code && (code>>3) < KEYBOARD_REPORT_BITS) {
+            bitmap.nkro.bits[code>>3] |= 1<<(code&7);
+        }
+    }
+    return &bitmap;
+}
+#endif
+
 static void send_keyboard(report_keyboard_t *report)
 {
-    uint8_t timeout = 255;
+    uint8_t ep = KEYBOARD_IN_EPNUM;
+    uint8_t size = KEYBOARD_EPSIZE;
 
     if (USB_DeviceState != DEVICE_STATE_Configured)
         return;
 
     /* Select the Keyboard Report Endpoint */
 #ifdef NKRO_ENABLE
+#ifdef NKRO_SHARED_ENABLE
+    if (keyboard_protocol && !keyboard_nkro) {
+        report = keyboard_report_bitmap(report);
+    }
+    if (keyboard_protocol) {
+#else
     if (keyboard_protocol && keyboard_nkro) {
+#endif
         /* Report protocol - NKRO */
-        Endpoint_SelectEndpoint(NKRO_IN_EPNUM);
-
-        /* Check if write ready for a polling interval around 1ms */
-        while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(4);
-        if (!Endpoint_IsReadWriteAllowed()) return;
-
-        /* Write Keyboard Report Data */
-        Endpoint_Write_Stream_LE(report, NKRO_EPSIZE, NULL);
+        ep = NKRO_IN_EPNUM;
+        size = NKRO_EPSIZE;
     }
-    else
 #endif
-    {
-        /* Boot protocol */
-        Endpoint_SelectEndpoint(KEYBOARD_IN_EPNUM);
-
-        /* Check if write ready for a polling interval around 10ms */
-        while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
-        if (!Endpoint_IsReadWriteAllowed()) return;
-
-        /* Write Keyboard Report Data */
-        Endpoint_Write_Stream_LE(report, KEYBOARD_EPSIZE, NULL);
-    }
-
-    /* Finalize the stream transfer to send the last packet */
-    Endpoint_ClearIN();
+    uint8_t sreg = SREG;
+    cli();
+    report_send(&keyboard_held, ep, report, size);
 
+    /* kept for idle repeat on start of frame and GetReport */
     keyboard_report_sent = *report;
+    keyboard_report_ep = ep;
+    keyboard_report_size = size;
+    keyboard_idle_count = 0;
+    SREG = sreg;
 }
 
 static void send_mouse(report_mouse_t *report)
 {
 #ifdef MOUSE_ENABLE
-    uint8_t timeout = 255;
-
     if (USB_DeviceState != DEVICE_STATE_Configured)
         return;
 
-    /* Select the Mouse Report Endpoint */
-    Endpoint_SelectEndpoint(MOUSE_IN_EPNUM);
-
-    /* Check if write ready for a polling interval around 10ms */
-    while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
-    if (!Endpoint_IsReadWriteAllowed()) return;
-
-    /* Write Mouse Report Data */
-    Endpoint_Write_Stream_LE(report, sizeof(report_mouse_t), NULL);
-
-    /* Finalize the stream transfer to send the last packet */
-    Endpoint_ClearIN();
+    report_send(&mouse_held, MOUSE_IN_EPNUM, report, sizeof(report_mouse_t));
 #endif
 }
 
-static void send_system(uint16_t data)
+#ifdef EXTRAKEY_ENABLE
+static void send_extra(held_report_t *held, uint8_t report_id, uint16_t data)
 {
-    uint8_t timeout = 255;
-
     if (USB_DeviceState != DEVICE_STATE_Configured)
         return;
 
     report_extra_t r = {
-        .report_id = REPORT_ID_SYSTEM,
+        .report_id = report_id,
         .usage = data
     };
-    Endpoint_SelectEndpoint(EXTRAKEY_IN_EPNUM);
-
-    /* Check if write ready for a polling interval around 10ms */
-    while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
-    if (!Endpoint_IsReadWriteAllowed()) return;
+    report_send(held, EXTRAKEY_IN_EPNUM, &r, sizeof(report_extra_t));
+}
+#endif
 
-    Endpoint_Write_Stream_LE(&r, sizeof(report_extra_t), NULL);
-    Endpoint_ClearIN();
+static void send_system(uint16_t data)
+{
+#ifdef EXTRAKEY_ENABLE
+    send_extra(&system_held, REPORT_ID_SYSTEM, data);
+#endif
 }
 
 static void send_consumer(uint16_t data)
 {
-    uint8_t timeout = 255;
-
-    if (USB_DeviceState != DEVICE_STATE_Configured)
-        return;
-
-    report_extra_t r = {
-        .report_id = REPORT_ID_CONSUMER,
-        .usage = data
-    };
-    Endpoint_SelectEndpoint(EXTRAKEY_IN_EPNUM);
-
-    /* Check if write ready for a polling interval around 10ms */
-    while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
-    if (!Endpoint_IsReadWriteAllowed()) return;
-
-    Endpoint_Write_Stream_LE(&r, sizeof(report_extra_t), NULL);
-    Endpoint_ClearIN();
+#ifdef EXTRAKEY_ENABLE
+    send_extra(&consumer_held, REPORT_ID_CONSUMER, data);
+#endif
 }
 
 
@@ -528,65 +1019,22 @@ static void send_consumer(uint16_t data)
  * sendchar
  ******************************************************************************/
 #ifdef CONSOLE_ENABLE
-#define SEND_TIMEOUT 5
 int8_t sendchar(uint8_t c)
 {
 #ifdef LUFA_DEBUG_SUART
     xmit(c);
 #endif
-    // Not wait once timeouted.
-    // Because sendchar() is called so many times, waiting each call causes big lag.
-    static bool timeouted = false;
-
-    // prevents Console_Task() from running during sendchar() runs.
-    // or char will be lost. These two function is mutually exclusive.
-    CONSOLE_FLUSH_SET(false);
-
-    if (USB_DeviceState != DEVICE_STATE_Configured)
-        return -1;
-
-    uint8_t ep = Endpoint_GetCurrentEndpoint();
-    Endpoint_SelectEndpoint(CONSOLE_IN_EPNUM);
-    if (!Endpoint_IsEnabled() || !Endpoint_IsConfigured()) {
-        goto ERROR_EXIT;
-    }
-
-    if (timeouted && !Endpoint_IsReadWriteAllowed()) {
-        goto ERROR_EXIT;
-    }
-
-    timeouted = false;
-
-    uint8_t timeout = SEND_TIMEOUT;
-    while (!Endpoint_IsReadWriteAllowed()) {
-        if (USB_DeviceState != DEVICE_STATE_Configured) {
-            goto ERROR_EXIT;
-        }
-        if (Endpoint_IsStalled()) {
-            goto ERROR_EXIT;
-        }
-        if (!(timeout--)) {
-            timeouted = true;
-            goto ERROR_EXIT;
-        }
-        _delay_ms(1);
-    }
-
-    Endpoint_Write_8(c);
-
-    // send when bank is full
-    if (!Endpoint_IsReadWriteAllowed()) {
-        while (!(Endpoint_IsINReady()));
-        Endpoint_ClearIN();
+    int8_t ret = 0;
+    uint8_t sreg = SREG;
+    cli();
+    if ((uint8_t)(console_head - console_tail) < CONSOLE_BUFFER_SIZE) {
+        console_buf[console_head++ & CONSOLE_BUFFER_MASK] = c;
     } else {
-        CONSOLE_FLUSH_SET(true);
+        if (console_drop != 0xFFFF) console_drop++;
+        ret = -1;
     }
-
-    Endpoint_SelectEndpoint(ep);
-    return 0;
-ERROR_EXIT:
-    Endpoint_SelectEndpoint(ep);
-    return -1;
+    SREG = sreg;
+    return ret;
 }
 #else
 int8_t sendchar(uint8_t c)
@@ -627,6 +1075,8 @@ int main(void)  __attribute__ ((weak));
 int main(void)
 {
     setup_mcu();
+    /* start boot timeline, keyboard_init() initializes timer again without clearing */
+    timer_init();
 
 #ifdef LUFA_DEBUG_SUART
     SUART_OUT_DDR |= (1<<SUART_OUT_BIT);
@@ -640,25 +1090,17 @@ int main(void)
     setup_usb();
     sei();
 
-    /* wait for USB startup & debug output */
-    while (USB_DeviceState != DEVICE_STATE_Configured) {
-#if defined(INTERRUPT_CONTROL_ENDPOINT)
-        ;
-#else
-        USB_USBTask();
-#endif
-    }
-    print("USB configured.\n");
-
-    /* init modules */
+    /* init modules while host enumerates, reports are dropped until configured */
     keyboard_init();
     host_set_driver(&lufa_driver);
 #ifdef SLEEP_LED_ENABLE
     sleep_led_init();
 #endif
+    boot_time.init = timer_read();
 
     print("Keyboard start.\n");
     hook_late_init();
+    bool configured = false;
     while (1) {
         while (USB_DeviceState == DEVICE_STATE_Suspended) {
 #ifdef LUFA_DEBUG
@@ -668,6 +1110,24 @@ int main(void)
         }
 
         keyboard_task();
+        if (!boot_time.scan) boot_time.scan = timer_read() | 1;
+
+        if (configured != (USB_DeviceState == DEVICE_STATE_Configured)) {
+            configured = !configured;
+            if (configured) {
+                print("USB configured.\n");
+                /* keys held during enumeration */
+                send_keyboard(keyboard_report);
+                if (!boot_time.report) {
+                    boot_time.report = timer_read() | 1;
+                    xprintf("boot(ms): init:%u scan:%u configured:%u report:%u\n",
+                            boot_time.init, boot_time.scan, boot_time.configured, boot_time.report);
+                }
+            }
+        }
+        Control_Task();
+        console_recv_task();
+        Raw_Task();
 
 #if !defined(INTERRUPT_CONTROL_ENDPOINT)
         USB_USBTask();
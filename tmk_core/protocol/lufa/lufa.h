@@ -56,6 +56,17 @@ extern "C" {
 
 extern host_driver_t lufa_driver;
 
+/* worst-case duration of USB interrupt handlers(us) */
+uint16_t usb_isr_max(void);
+
+/* longest time a report waited for host to take it(ms) */
+uint16_t usb_report_latency_max(void);
+
+#ifdef CONSOLE_ENABLE
+/* number of console chars dropped on full buffer */
+uint16_t console_dropped(void);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,22 +1,108 @@
 #include <stdint.h>
+#include "cmsis.h"
 #include "USBHID.h"
 #include "USBHID_Types.h"
 #include "USBDescriptor.h"
 #include "HIDKeyboard.h"
+#include "mbed/timer_mbed.h"
 
 #define DEFAULT_CONFIGURATION (1)
 
 
-HIDKeyboard::HIDKeyboard(uint16_t vendor_id, uint16_t product_id, uint16_t product_release): USBDevice(vendor_id, product_id, product_release)
+HIDKeyboard::HIDKeyboard(uint16_t vendor_id, uint16_t product_id, uint16_t product_release): USBDevice(vendor_id, product_id, product_release),
+    led_state(0), report_busy(false), report_waiting(0), report_wait_max(0),
+    report_lost(0), report_start_failed(0)
 {
     USBDevice::connect();
 }
 
+/*
+ * Reports are sent asynchronously and started from EPINT_IN_callback when
+ * the transfer in progress completes. A newer report replaces the last
+ * waiting one only if it covers it(see report.h), otherwise it waits after
+ * it. When two are waiting the second is merged into the first, so that a
+ * press is never lost before host sees it.
+ */
 bool HIDKeyboard::sendReport(report_keyboard_t report) {
-    USBDevice::write(EP1IN, report.raw, sizeof(report), MAX_PACKET_SIZE_EP1);
+    if (!configured()) {
+        return false;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t last = report_waiting - 1;
+    if (report_waiting && report_keyboard_covers(&report_next[last], &report, sizeof(report), false)) {
+        report_next[last] = report;
+    } else {
+        if (report_waiting == 2) {
+            if (!report_keyboard_merge(&report_next[0], &report_next[1], sizeof(report), false)) {
+                report_lost++;
+            }
+            report_waiting = 1;
+        }
+        report_next[report_waiting] = report;
+        report_wait_start[report_waiting] = timer_read_us();
+        report_waiting++;
+    }
+    if (!report_busy) {
+        startNext();
+    }
+    __set_PRIMASK(primask);
     return true;
 }
 
+bool HIDKeyboard::startReport(void) {
+    return endpointWrite(EPINT_IN, report_in.raw, sizeof(report_in)) == EP_PENDING;
+}
+
+/* Start first waiting report, called with interrupt disabled or in USB
+ * interrupt. A report the endpoint fails to start is kept waiting and is
+ * tried again on next sendReport(). */
+void HIDKeyboard::startNext(void) {
+    report_busy = false;
+    if (!report_waiting) {
+        return;
+    }
+
+    report_in = report_next[0];
+    if (!startReport()) {
+        report_start_failed++;
+        return;
+    }
+    report_busy = true;
+
+    uint32_t wait = timer_read_us() - report_wait_start[0];
+    if (wait > report_wait_max) {
+        report_wait_max = wait;
+    }
+    report_next[0] = report_next[1];
+    report_wait_start[0] = report_wait_start[1];
+    report_waiting--;
+}
+
+/* Called in USB interrupt when report on EPINT_IN is sent */
+bool HIDKeyboard::EPINT_IN_callback() {
+    startNext();
+    return true;
+}
+
+void HIDKeyboard::USBCallback_busReset(void) {
+    report_busy = false;
+    report_waiting = 0;
+}
+
+uint32_t HIDKeyboard::reportWaitMax() {
+    return report_wait_max;
+}
+
+uint16_t HIDKeyboard::reportLost() {
+    return report_lost;
+}
+
+uint16_t HIDKeyboard::reportStartFailed() {
+    return report_start_failed;
+}
+
 uint8_t HIDKeyboard::leds() {
     return led_state;
 }
@@ -28,6 +114,8 @@ bool HIDKeyboard::USBCallback_setConfiguration(uint8_t configuration) {
 
     // Configure endpoints > 0
     addEndpoint(EPINT_IN, MAX_PACKET_SIZE_EPINT);
+    report_busy = false;
+    report_waiting = 0;
     //addEndpoint(EPINT_OUT, MAX_PACKET_SIZE_EPINT);
 
     // We activate the endpoint to be able to recceive data
@@ -10,8 +10,14 @@ class HIDKeyboard : public USBDevice {
 public:
     HIDKeyboard(uint16_t vendor_id = 0xFEED, uint16_t product_id = 0xabed, uint16_t product_release = 0x0001);
 
+    /* queue report and return without waiting for host */
     bool sendReport(report_keyboard_t report);
     uint8_t leds(void);
+    /* longest time(us) a queued report waited for endpoint */
+    uint32_t reportWaitMax(void);
+    /* presses lost while reports waited, and reports endpoint failed to start */
+    uint16_t reportLost(void);
+    uint16_t reportStartFailed(void);
 protected:
     uint16_t reportLength;
     virtual bool USBCallback_setConfiguration(uint8_t configuration);
@@ -24,8 +30,22 @@ protected:
     //virtual uint8_t * deviceDesc();
     virtual bool USBCallback_request();
     virtual void USBCallback_requestCompleted(uint8_t * buf, uint32_t length);
+    virtual void USBCallback_busReset(void);
+    virtual bool EPINT_IN_callback();
 private:
     uint8_t led_state;
+
+    /* report in transfer and up to two reports waiting for its completion */
+    bool startReport(void);
+    void startNext(void);
+    report_keyboard_t report_in;
+    report_keyboard_t report_next[2];
+    uint32_t report_wait_start[2];
+    volatile bool report_busy;
+    volatile uint8_t report_waiting;
+    uint32_t report_wait_max;
+    uint16_t report_lost;
+    uint16_t report_start_failed;
 };
 
 #endif
@@ -327,6 +327,7 @@ MSG_LINKING = Linking:
 MSG_COMPILING = Compiling C:
 MSG_COMPILING_CPP = Compiling C++:
 MSG_ASSEMBLING = Assembling:
+MSG_ACTION_SCAN = Scanning keymap for actions:
 MSG_CLEANING = Cleaning project:
 MSG_CREATING_LIBRARY = Creating library:
 
@@ -345,11 +346,19 @@ LST = $(patsubst %.c,$(OBJDIR)/%.lst,$(patsubst %.cpp,$(OBJDIR)/%.lst,$(patsubst
 GENDEPFLAGS = -MMD -MP -MF .dep/$(subst /,_,$@).d
 
 
+# Header disabling action kinds unused in keymap.
+ifeq (yes,$(strip $(ACTION_SCAN_ENABLE)))
+ACTION_SCAN_SRC ?= keymap.c
+ACTION_SCAN_H = $(OBJDIR)/action_scan.h
+ACTION_SCAN_FLAGS = -include $(ACTION_SCAN_H)
+endif
+
+
 # Combine all necessary flags and optional flags.
 # Add target processor to flags.
 # You can give extra flags at 'make' command line like: make EXTRAFLAGS=-DFOO=bar
-ALL_CFLAGS = -mmcu=$(MCU) $(CFLAGS) $(GENDEPFLAGS) $(EXTRAFLAGS)
-ALL_CPPFLAGS = -mmcu=$(MCU) -x c++ $(CPPFLAGS) $(GENDEPFLAGS) $(EXTRAFLAGS)
+ALL_CFLAGS = -mmcu=$(MCU) $(CFLAGS) $(ACTION_SCAN_FLAGS) $(GENDEPFLAGS) $(EXTRAFLAGS)
+ALL_CPPFLAGS = -mmcu=$(MCU) -x c++ $(CPPFLAGS) $(ACTION_SCAN_FLAGS) $(GENDEPFLAGS) $(EXTRAFLAGS)
 ALL_ASFLAGS = -mmcu=$(MCU) -x assembler-with-cpp $(ASFLAGS) $(EXTRAFLAGS)
 
 
@@ -586,6 +595,23 @@ $(OBJDIR)/%.o : %.S
 	$(CC) -c $(ALL_ASFLAGS) $< -o $@
 
 
+# Scan keymap compiled with all actions and write header only when changed.
+# Headers included by keymap source are tracked in .dep like objects.
+ifdef ACTION_SCAN_H
+$(OBJ): $(ACTION_SCAN_H)
+
+$(ACTION_SCAN_H): $(ACTION_SCAN_SRC) $(CONFIG_H)
+	@echo
+	@echo $(MSG_ACTION_SCAN) $<
+	$(CC) -c -mmcu=$(MCU) $(filter-out -Wa%,$(CFLAGS)) $(EXTRAFLAGS) \
+	    -MMD -MP -MT $@ -MF .dep/$(subst /,_,$@).d $< -o $(OBJDIR)/action_scan.o
+	sh $(TMK_DIR)/tool/action_scan.sh $(OBJDUMP) $(OBJCOPY) $(OBJDIR)/action_scan.o \
+	    "$$(echo 'MATRIX_ROWS*MATRIX_COLS' | $(CC) -E -P -mmcu=$(MCU) $(filter-out -Wa%,$(CFLAGS)) -x c - | tail -n 1)" > $@.tmp
+	cmp -s $@.tmp $@ || mv $@.tmp $@
+	$(REMOVE) $@.tmp
+endif
+
+
 # Create preprocessed source for use in sending a bug report.
 %.i : %.c
 	$(CC) -E -mmcu=$(MCU) $(CFLAGS) $< -o $@ 
@@ -0,0 +1,79 @@
+#!/bin/sh
+#
+# Scan compiled keymap for action kinds in use and print header which
+# disables unused ones with NO_ACTION_* options.
+#
+# usage: action_scan.sh <objdump> <objcopy> <keymap object> <matrix size>
+#
+# keymaps(or actionmaps), fn_actions and combo_actions are read from the
+# object. Layer support is kept when keymap has more than one layer.
+#
+OBJDUMP=$1
+OBJCOPY=$2
+OBJ=$3
+MATRIX_SIZE=${4:+$(($4))}
+TMP=${TMPDIR:-/tmp}/action_scan.$$
+trap 'rm -f $TMP.bin' 0
+
+# print size and bytes of symbol in decimal
+symbol_bytes() {
+    set -- $($OBJDUMP -t "$OBJ" | awk -v sym="$1" '$NF == sym { print $(NF-2), $1, $(NF-1); exit }')
+    [ $# -eq 3 ] || return 0
+    $OBJCOPY -O binary -j "$1" "$OBJ" $TMP.bin || return 0
+    echo $((0x$3))
+    od -An -v -tu1 -j $((0x$2)) -N $((0x$3)) $TMP.bin
+}
+
+awk -v matrix="$MATRIX_SIZE" \
+    -v keymaps="$(symbol_bytes keymaps)" \
+    -v actionmaps="$(symbol_bytes actionmaps)" \
+    -v fn_actions="$(symbol_bytes fn_actions)" \
+    -v combo_actions="$(symbol_bytes combo_actions)" '
+function use(code,    kind, opt) {
+    kind = int(code / 4096)
+    opt = int(code / 256) % 16
+    if (kind == 2 || kind == 3) {           # ACT_LMODS_TAP, ACT_RMODS_TAP
+        tapping = 1
+        if (code % 256 == 0) oneshot = 1    # MODS_ONESHOT
+    } else if (kind == 8) {                 # ACT_LAYER
+        layer = 1
+    } else if (kind == 10 || kind == 11) {  # ACT_LAYER_TAP, ACT_LAYER_TAP_EXT
+        layer = 1
+        tapping = 1
+    } else if (kind == 12) {                # ACT_MACRO
+        macro = 1
+        if (opt >= 8) tapping = 1           # FUNC_TAP
+    } else if (kind == 15) {                # ACT_FUNCTION
+        func = 1
+        if (opt >= 8) tapping = 1           # FUNC_TAP
+    }
+}
+# size followed by 16-bit actions in little endian
+function use_words(list,    b, n, i) {
+    n = split(list, b)
+    for (i = 2; i < n; i += 2) use(b[i] + b[i + 1] * 256)
+}
+function unused(name) {
+    printf "#ifndef NO_ACTION_%s\n#define NO_ACTION_%s\n#endif\n", name, name
+}
+BEGIN {
+    print "/* Generated by action_scan.sh from keymap. Do not edit. */"
+    # keep everything unless layout of keymap is known
+    if (!matrix) exit
+    if (split(keymaps, b)) {
+        if (b[1] > matrix) layer = 1
+    } else if (split(actionmaps, b)) {
+        if (b[1] > matrix * 2) layer = 1
+        use_words(actionmaps)
+    } else {
+        exit
+    }
+    use_words(fn_actions)
+    use_words(combo_actions)
+
+    if (!layer)    unused("LAYER")
+    if (!tapping)  unused("TAPPING")
+    if (!oneshot)  unused("ONESHOT")
+    if (!macro)    unused("MACRO")
+    if (!func)     unused("FUNCTION")
+}'
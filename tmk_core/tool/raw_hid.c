@@ -0,0 +1,171 @@
+/*
+ * Host utility for Raw HID interface(RAW_ENABLE) on Linux hidraw
+ *
+ * build:   make -C tmk_core/tool raw_hid
+ * usage:   raw_hid [-d /dev/hidrawN] <command> [args]
+ *
+ *   version            protocol version and keyboard IDs
+ *   counters           scan rate, report counts and matrix errors
+ *   watch              print counters every second
+ *   layer              layer state and default layer state
+ *   matrix             matrix snapshot
+ *   get <id>           read setting(0:debug 1:default layer 2:nkro)
+ *   set <id> <value>   write setting
+ *
+ * Without -d the first hidraw device with vendor usage page 0xFF60 is used.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+#include "raw_hid.h"
+
+
+static int fd = -1;
+static uint8_t buf[RAW_HID_REPORT_SIZE];
+
+static uint16_t get16(const uint8_t *p) { return p[0] | p[1]<<8; }
+static uint32_t get32(const uint8_t *p) { return get16(p) | (uint32_t)get16(p + 2)<<16; }
+
+/* raw interface has usage page 0xFF60 at top of its report descriptor */
+static int is_raw_hid(int f)
+{
+    struct hidraw_report_descriptor desc;
+    int size = 0;
+    if (ioctl(f, HIDIOCGRDESCSIZE, &size) < 0 || size < 3) return 0;
+    desc.size = size;
+    if (ioctl(f, HIDIOCGRDESC, &desc) < 0) return 0;
+    return desc.value[0] == 0x06 && desc.value[1] == 0x60 && desc.value[2] == 0xFF;
+}
+
+static int open_device(const char *path)
+{
+    if (path) return open(path, O_RDWR);
+
+    char name[32];
+    for (int i = 0; i < 64; i++) {
+        snprintf(name, sizeof(name), "/dev/hidraw%d", i);
+        int f = open(name, O_RDWR);
+        if (f < 0) continue;
+        if (is_raw_hid(f)) return f;
+        close(f);
+    }
+    return -1;
+}
+
+/* send request in buf and receive response into buf */
+static int request(uint8_t command, uint8_t arg0, uint8_t arg1)
+{
+    uint8_t out[RAW_HID_REPORT_SIZE + 1] = { 0 };   /* report ID 0 first */
+    out[1] = command;
+    out[2] = arg0;
+    out[3] = arg1;
+    if (write(fd, out, sizeof(out)) < 0) {
+        perror("write");
+        return -1;
+    }
+
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    do {
+        if (poll(&pfd, 1, 1000) <= 0) {
+            fprintf(stderr, "no response\n");
+            return -1;
+        }
+        if (read(fd, buf, sizeof(buf)) < (int)sizeof(buf)) {
+            perror("read");
+            return -1;
+        }
+    } while (buf[0] != command);
+
+    if (buf[1] != RAW_HID_OK) {
+        fprintf(stderr, "error: %s\n", buf[1] == RAW_HID_UNKNOWN ? "unknown command" : "invalid argument");
+        return -1;
+    }
+    return 0;
+}
+
+static int print_counters(void)
+{
+    if (request(RAW_HID_COUNTERS, 0, 0)) return -1;
+    printf("timer: %u scan_rate: %u scan_gap_max: %u sent: %u suppressed: %u matrix_errors: %u\n",
+           get32(&buf[2]), get16(&buf[6]), get16(&buf[8]),
+           get16(&buf[10]), get16(&buf[12]), get16(&buf[14]));
+    printf("usb_isr_max: %uus report_latency_max: %ums\n", get16(&buf[16]), get16(&buf[18]));
+    return 0;
+}
+
+static int print_matrix(void)
+{
+    if (request(RAW_HID_VERSION, 0, 0)) return -1;
+    uint8_t rows = buf[3], cols = buf[4];
+    uint8_t width = (cols + 7) / 8;
+
+    for (uint8_t row = 0; row < rows; ) {
+        if (request(RAW_HID_MATRIX, row, 0)) return -1;
+        uint8_t count = buf[3];
+        if (!count) break;
+        for (uint8_t i = 0; i < count; i++, row++) {
+            uint32_t bits = 0;
+            for (uint8_t b = 0; b < width; b++) bits |= (uint32_t)buf[4 + i * width + b]<<(8 * b);
+            printf("%02X: ", row);
+            for (uint8_t c = 0; c < cols; c++) putchar(bits & (1UL<<c) ? '1' : '.');
+            putchar('\n');
+        }
+    }
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: raw_hid [-d /dev/hidrawN] version|counters|watch|layer|matrix|get <id>|set <id> <value>\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    if (argc > 2 && !strcmp(argv[1], "-d")) {
+        path = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 2) usage();
+
+    fd = open_device(path);
+    if (fd < 0) {
+        fprintf(stderr, "raw hid device not found\n");
+        return 1;
+    }
+
+    const char *cmd = argv[1];
+    int ret = 0;
+    if (!strcmp(cmd, "version")) {
+        ret = request(RAW_HID_VERSION, 0, 0);
+        if (!ret) printf("protocol: %u matrix: %ux%u id: %04X:%04X ver: %04X\n",
+                         buf[2], buf[3], buf[4], get16(&buf[5]), get16(&buf[7]), get16(&buf[9]));
+    } else if (!strcmp(cmd, "counters")) {
+        ret = print_counters();
+    } else if (!strcmp(cmd, "watch")) {
+        while (!(ret = print_counters())) sleep(1);
+    } else if (!strcmp(cmd, "layer")) {
+        ret = request(RAW_HID_LAYER, 0, 0);
+        if (!ret) printf("layer_state: %08X default_layer_state: %08X\n", get32(&buf[2]), get32(&buf[6]));
+    } else if (!strcmp(cmd, "matrix")) {
+        ret = print_matrix();
+    } else if (!strcmp(cmd, "get") && argc == 3) {
+        ret = request(RAW_HID_GET_SETTING, strtoul(argv[2], NULL, 0), 0);
+        if (!ret) printf("%u: %u\n", buf[2], buf[3]);
+    } else if (!strcmp(cmd, "set") && argc == 4) {
+        ret = request(RAW_HID_SET_SETTING, strtoul(argv[2], NULL, 0), strtoul(argv[3], NULL, 0));
+        if (!ret) printf("%u: %u\n", buf[2], buf[3]);
+    } else {
+        usage();
+    }
+    close(fd);
+    return ret ? 1 : 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Host test of 6KRO rollover(USB_6KRO_ENABLE) in action_util.c
+ *
+ * Random add/del/clear sequences are run on action_util.c and on the
+ * previous circular buffer algorithm kept here as reference. After each
+ * operation both must have the same keys in the report, the same press
+ * order and the same first key.
+ *
+ * build and run:   make -C tmk_core/tool test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../common/action_util.c"
+
+
+/* stubs for action_util.c */
+void host_keyboard_send(report_keyboard_t *report) { (void)report; }
+uint16_t timer_read(void) { return 0; }
+
+
+/* reference: circular buffer algorithm before linked slots */
+#define RO_ADD(a, b) ((a + b) % KEYBOARD_REPORT_KEYS)
+#define RO_SUB(a, b) ((a - b + KEYBOARD_REPORT_KEYS) % KEYBOARD_REPORT_KEYS)
+#define RO_INC(a) RO_ADD(a, 1)
+#define RO_DEC(a) RO_SUB(a, 1)
+static uint8_t ref_keys[KEYBOARD_REPORT_KEYS];
+static int8_t cb_head = 0;
+static int8_t cb_tail = 0;
+static int8_t cb_count = 0;
+
+static void ref_clear(void)
+{
+    memset(ref_keys, 0, sizeof(ref_keys));
+    cb_head = cb_tail = cb_count = 0;
+}
+
+static uint8_t ref_first(void)
+{
+    uint8_t i = cb_head;
+    do {
+        if (ref_keys[i] != 0) {
+            break;
+        }
+        i = RO_INC(i);
+    } while (i != cb_tail);
+    return ref_keys[i];
+}
+
+static void ref_add(uint8_t code)
+{
+    int8_t i = cb_head;
+    int8_t empty = -1;
+    if (cb_count) {
+        do {
+            if (ref_keys[i] == code) {
+                return;
+            }
+            if (empty == -1 && ref_keys[i] == 0) {
+                empty = i;
+            }
+            i = RO_INC(i);
+        } while (i != cb_tail);
+        if (i == cb_tail) {
+            if (cb_tail == cb_head) {
+                if (empty == -1) {
+                    cb_head = RO_INC(cb_head);
+                    cb_count--;
+                }
+                else {
+                    uint8_t offset = 1;
+                    i = RO_INC(empty);
+                    do {
+                        if (ref_keys[i] != 0) {
+                            ref_keys[empty] = ref_keys[i];
+                            ref_keys[i] = 0;
+                            empty = RO_INC(empty);
+                        }
+                        else {
+                            offset++;
+                        }
+                        i = RO_INC(i);
+                    } while (i != cb_tail);
+                    cb_tail = RO_SUB(cb_tail, offset);
+                }
+            }
+        }
+    }
+    ref_keys[cb_tail] = code;
+    cb_tail = RO_INC(cb_tail);
+    cb_count++;
+}
+
+static void ref_del(uint8_t code)
+{
+    uint8_t i = cb_head;
+    if (cb_count) {
+        do {
+            if (ref_keys[i] == code) {
+                ref_keys[i] = 0;
+                cb_count--;
+                if (cb_count == 0) {
+                    cb_tail = cb_head = 0;
+                }
+                if (i == RO_DEC(cb_tail)) {
+                    do {
+                        cb_tail = RO_DEC(cb_tail);
+                        if (ref_keys[RO_DEC(cb_tail)] != 0) {
+                            break;
+                        }
+                    } while (cb_tail != cb_head);
+                }
+                break;
+            }
+            i = RO_INC(i);
+        } while (i != cb_tail);
+    }
+}
+
+/* keys in order of press, returns number of keys */
+static uint8_t ref_order(uint8_t *order)
+{
+    uint8_t n = 0;
+    if (!cb_count) return 0;
+    uint8_t i = cb_head;
+    do {
+        if (ref_keys[i]) order[n++] = ref_keys[i];
+        i = RO_INC(i);
+    } while (i != cb_tail);
+    return n;
+}
+
+static uint8_t ro_order(uint8_t *order)
+{
+    uint8_t n = 0;
+    for (int8_t i = ro_oldest; i != RO_NONE; i = ro_next[i]) {
+        order[n++] = keyboard_report->keys[i];
+    }
+    return n;
+}
+
+
+static unsigned long step;
+
+static void dump(const char *name, const uint8_t *order, uint8_t n)
+{
+    printf("  %s:", name);
+    for (uint8_t i = 0; i < n; i++) printf(" %02X", order[i]);
+    printf("\n");
+}
+
+static int check(const char *op, uint8_t code)
+{
+    uint8_t ref[KEYBOARD_REPORT_KEYS], ro[KEYBOARD_REPORT_KEYS];
+    uint8_t ref_n = ref_order(ref);
+    uint8_t ro_n = ro_order(ro);
+
+    uint8_t in_report = 0;
+    for (uint8_t i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+        if (keyboard_report->keys[i]) in_report++;
+    }
+
+    if (ref_n == ro_n && ro_n == in_report && has_anykey() == ro_n &&
+            memcmp(ref, ro, ro_n) == 0 && get_first_key() == ref_first()) {
+        return 0;
+    }
+    printf("FAIL at step %lu after %s %02X\n", step, op, code);
+    dump("reference", ref, ref_n);
+    dump("rollover ", ro, ro_n);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long steps = argc > 1 ? strtoul(argv[1], NULL, 0) : 200000;
+    srand(1);
+
+    clear_keys();
+    ref_clear();
+    for (step = 0; step < steps; step++) {
+        /* small code range so that keys repeat and report overflows */
+        uint8_t code = KC_A + rand() % 10;
+        int r = rand() % 100;
+        const char *op;
+        if (r < 1) {
+            op = "clear";
+            clear_keys();
+            ref_clear();
+        } else if (r < 55) {
+            op = "add";
+            add_key(code);
+            ref_add(code);
+        } else {
+            op = "del";
+            del_key(code);
+            ref_del(code);
+        }
+        if (check(op, code)) return 1;
+    }
+    printf("rollover: %lu steps OK\n", steps);
+    return 0;
+}